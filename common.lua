@@ -1,8 +1,33 @@
 -- Copyright lowRISC Contributors.
 -- SPDX-License-Identifier: Apache-2.0
 
+local librariesdir = path.join(os.scriptdir(), "libraries")
+local scriptsdir = path.join(os.scriptdir(), "scripts")
+local sizeBudget = path.join(os.scriptdir(), "size_budget.toml")
+
+-- Instruments the functions of the compartment being described, when built
+-- with the profile option, so that the profiler can sample its call stacks,
+-- or with the stack-usage option, so that its threads' stack depths are
+-- measured.
+function instrumented()
+    local profile = has_config("profile")
+    local stackUsage = has_config("stack-usage")
+    if profile or stackUsage then
+        add_cxflags("-finstrument-functions")
+        add_files(path.join(librariesdir, "instrument_hooks.cc"))
+    end
+    if profile then
+        add_defines("SONATA_PROFILE")
+    end
+    if stackUsage then
+        add_defines("SONATA_STACK_USAGE")
+    end
+end
+
 function convert_to_uf2(target)
     local firmware = target:targetfile()
+    -- Fails if the firmware has grown beyond its budget in size_budget.toml.
+    os.execv("python3", { path.join(scriptsdir, "size_report.py"), "--check", "--budget", sizeBudget, firmware })
     os.execv("llvm-strip", { firmware, "-o", firmware .. ".strip" })
     os.execv("uf2conv", { firmware .. ".strip", "-b0x00000000", "-f0x6CE29E60", "-co", firmware .. ".slot1.uf2" })
     os.execv("uf2conv", { firmware .. ".strip", "-b0x10000000", "-f0x6CE29E60", "-co", firmware .. ".slot2.uf2" })
@@ -1,23 +1,56 @@
 // Copyright lowRISC Contributors.
 // SPDX-License-Identifier: Apache-2.0
 
+#include "echo.hh"
+#include <cheri.hh>
 #include <compartment.h>
-//#include <debug.hh>
+#include <locks.hh>
 #include <platform-uart.hh>
 #include <thread.h>
 
-/// Expose debugging features unconditionally for this compartment.
-// using Debug = ConditionalDebug<true, "led walk compartment">;
+#include "../../libraries/thread_stats.hh"
+#include "../../libraries/uart_lines.hh"
 
-/// Thread entry point.
+/// The lines being typed or pasted on the UART.
+static sonata::UartLines<> lines;
+
+/// Held by a consumer while taking a line, as `lines` has only one consumer.
+static FlagLock consumerLock;
+
+/**
+ * Thread entry point.  Echoes everything received on the UART, a whole
+ * receive FIFO at a time so that pasted bursts don't overflow it, and
+ * collects lines for `echo_line_next`.
+ */
 [[noreturn]] void __cheri_compartment("echo") entry_point()
 {
 	auto uart = MMIO_CAPABILITY(OpenTitanUart, uart);
 
-	char ch = '\n';
 	while (true)
 	{
-		ch = uart->blocking_read();
-		uart->blocking_write(ch);
+		lines.poll(uart);
+		sonata::thread_stats_checkpoint();
+	}
+}
+
+const char *echo_line_next(Timeout *timeout, size_t *length)
+{
+	if (!CHERI::check_pointer<CHERI::PermissionSet{
+	      CHERI::Permission::Load, CHERI::Permission::Store}>(timeout) ||
+	    !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Store}>(
+	      length))
+	{
+		return nullptr;
+	}
+	LockGuard guard{consumerLock, timeout};
+	if (!guard || !lines.wait(timeout))
+	{
+		return nullptr;
 	}
+	return lines.next(*length);
+}
+
+int echo_line_release(const char *line)
+{
+	return lines.release(line);
 }
@@ -0,0 +1,23 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <compartment.h>
+#include <stddef.h>
+#include <timeout.h>
+
+/**
+ * Waits for the next line typed or pasted on the UART, ended by a carriage
+ * return or newline, and returns it without its ending, setting `length` to
+ * its length.  The line is a read-only capability to the echo compartment's
+ * buffer, not a copy, and must be passed to `echo_line_release` when done
+ * with.  Returns nullptr if the timeout expires or an argument is invalid.
+ */
+__cheri_compartment("echo") const char *echo_line_next(Timeout *timeout,
+                                                       size_t  *length);
+
+/**
+ * Returns the buffer of a line from `echo_line_next` to the echo
+ * compartment.  Returns zero, or `-EINVAL` if `line` is not a held line.
+ */
+__cheri_compartment("echo") int echo_line_release(const char *line);
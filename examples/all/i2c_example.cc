@@ -7,6 +7,9 @@
 #include <platform-i2c.hh>
 #include <thread.h>
 
+#include "../../libraries/thread_stats.hh"
+#include "../../libraries/token_log.hh"
+
 /// Expose debugging features unconditionally for this compartment.
 using Debug = ConditionalDebug<true, "i2c example">;
 
@@ -45,21 +48,24 @@ static void id_eeprom_report(Mmio<OpenTitanI2c> i2c, const uint8_t IdAddr)
 		Debug::log("Failed to read EEPROM ID of device at address {}", IdAddr);
 	}
 
-	Debug::log("EEPROM ID of device at address {}:", IdAddr);
+	sonata::log<"EEPROM ID of device at address 0x{}:">(
+	  sonata::format::Hex{IdAddr, 2});
 	for (size_t idx = 0u; idx + 4 < sizeof(data); idx += 4)
 	{
 		auto asChar = [](uint8_t val) -> char {
 			return static_cast<char>(isprint(val) ? val : '.');
 		};
-		Debug::log("\t{}{}{}{} | {} {} {} {}",
-		           asChar(data[idx + 0]),
-		           asChar(data[idx + 1]),
-		           asChar(data[idx + 2]),
-		           asChar(data[idx + 3]),
-		           data[idx + 0],
-		           data[idx + 1],
-		           data[idx + 2],
-		           data[idx + 3]);
+		// The rows are handed to the drain thread rather than written here,
+		// so the dump doesn't wait on the UART.
+		using sonata::format::Hex;
+		sonata::log<"\t{}{}{}{} | 0x{} 0x{} 0x{} 0x{}">(asChar(data[idx + 0]),
+		                                                asChar(data[idx + 1]),
+		                                                asChar(data[idx + 2]),
+		                                                asChar(data[idx + 3]),
+		                                                Hex{data[idx + 0], 2},
+		                                                Hex{data[idx + 1], 2},
+		                                                Hex{data[idx + 2], 2},
+		                                                Hex{data[idx + 3], 2});
 	}
 }
 
@@ -81,6 +87,7 @@ static void id_eeprom_report(Mmio<OpenTitanI2c> i2c, const uint8_t IdAddr)
 	while (true)
 	{
 		read_temperature_sensor_value(i2c1, "temporature", 0);
+		sonata::thread_stats_checkpoint();
 		thread_millisecond_wait(4000);
 	}
 }
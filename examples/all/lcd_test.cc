@@ -4,22 +4,37 @@
 #include <compartment.h>
 #include <thread.h>
 
-#include "../../libraries/lcd.hh"
+#include "../../libraries/lcd_service.hh"
+#include "../../libraries/thread_stats.hh"
 #include "lowrisc_logo.h"
 
+// If enabled, the logo is streamed from the asset store in SPI flash (packed
+// by `scripts/pack_assets.py`) instead of being linked into the firmware,
+// which saves 16 KiB of memory.
+static constexpr bool LogoFromFlash = false;
+
 /// Thread entry point.
 void __cheri_compartment("lcd_test") lcd_test()
 {
 	using namespace sonata::lcd;
 
-	auto lcd      = SonataLcd();
-	auto screen   = Rect::from_point_and_size(Point::ORIGIN, lcd.resolution());
-	auto logoRect = screen.centered_subrect({105, 80});
-	lcd.draw_image_rgb565(logoRect, lowriscLogo105x80);
+	auto screen =
+	  Rect::from_point_and_size(Point::ORIGIN, SharedLcd::display_resolution());
+	SharedLcd lcd{screen};
+	auto      logoRect = screen.centered_subrect({105, 80});
+	if constexpr (LogoFromFlash)
+	{
+		lcd.draw_asset({logoRect.left, logoRect.top}, "lowrisc_logo");
+	}
+	else
+	{
+		lcd.draw_image_rgb565(logoRect, lowriscLogo105x80);
+	}
 	lcd.draw_str({1, 1}, "Hello world!", Color::White, Color::Black);
 
 	while (true)
 	{
+		sonata::thread_stats_checkpoint();
 		thread_millisecond_wait(500);
 	}
 }
@@ -6,6 +6,8 @@
 #include <platform-gpio.hh>
 #include <thread.h>
 
+#include "../../libraries/thread_stats.hh"
+
 /// Expose debugging features unconditionally for this compartment.
 using Debug = ConditionalDebug<true, "Led Walk Raw">;
 
@@ -30,6 +32,7 @@ void __cheri_compartment("led_walk_raw") start_walking()
 		{
 			gpio->led_off(count);
 		};
+		sonata::thread_stats_checkpoint();
 		thread_millisecond_wait(500);
 		switchOn = (count == NumLeds - 1) ? !switchOn : switchOn;
 		count    = (count < NumLeds - 1) ? count + 1 : 0;
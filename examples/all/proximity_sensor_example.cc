@@ -11,6 +11,12 @@
 #include <platform-rgbctrl.hh>
 #include <thread.h>
 
+#include "../../libraries/lcd_service.hh"
+#include "../../libraries/sample_ring.hh"
+#include "../../libraries/telemetry.hh"
+#include "../../libraries/thread_stats.hh"
+#include "../../libraries/token_log.hh"
+
 const uint8_t ApdS9960Enable = 0x80;
 const uint8_t ApdS9960Id     = 0x92;
 const uint8_t ApdS9960Ppc    = 0x8E;
@@ -26,6 +32,15 @@ using Debug = ConditionalDebug<true, "proximity sensor example">;
 template<class T>
 using Mmio = volatile T *;
 
+/// Height of the live proximity graph along the bottom of the display.
+static constexpr uint32_t GraphHeight = 22;
+
+/**
+ * Proximity readings, passed from the sensor thread to the graph thread
+ * without either waiting for the other.
+ */
+static SampleRing<uint8_t, 16> proximitySamples;
+
 static void setup_proximity_sensor(Mmio<OpenTitanI2c> i2c, const uint8_t Addr)
 {
 	uint8_t buf[2];
@@ -100,14 +115,54 @@ static uint8_t read_proximity_sensor(Mmio<OpenTitanI2c> i2c)
 
 	setup_proximity_sensor(i2c1, ApdS9960I2cAddress);
 
+	// Readings, and how many log lines have been dropped, for collection by
+	// scripts/telemetry_collector.py.
+	sonata::telemetry::Channel<uint8_t>  proximityChannel{1, "proximity"};
+	sonata::telemetry::Channel<uint32_t> droppedChannel{2, "dropped_lines"};
+	uint32_t                             reading = 0;
+
 	while (true)
 	{
 		uint8_t prox = read_proximity_sensor(i2c1);
-		Debug::log("Proximity is {}\r", prox);
+		proximityChannel.publish(prox);
+		if (reading++ % 10 == 0)
+		{
+			droppedChannel.publish(async_log_dropped(0));
+		}
+		// Logged through the drain thread, so the loop never waits on the
+		// UART.
+		sonata::log<"Proximity is {}\r">(prox);
 		rgbled->rgb(SonataRgbLed::Led0, ((prox) >> 3), 0, 0);
 		rgbled->rgb(SonataRgbLed::Led1, 0, (255 - prox) >> 3, 0);
 		rgbled->update();
+		proximitySamples.push(prox);
+		sonata::thread_stats_checkpoint();
 
 		thread_millisecond_wait(100);
 	}
 }
+
+/// Thread entry point for the live graph of proximity readings.
+[[noreturn]] void __cheri_compartment("proximity_sensor_example") run_graph()
+{
+	using namespace sonata::lcd;
+
+	Size       screen = SharedLcd::display_resolution();
+	SharedLcd  lcd{Rect::from_point_and_size({0, screen.height - GraphHeight},
+	                                         {screen.width, GraphHeight})};
+	StripChart chart{
+	  Rect::from_point_and_size(Point::ORIGIN, lcd.resolution()), 0, 255};
+	chart.clear(lcd);
+
+	while (true)
+	{
+		Timeout timeout{UnlimitedTimeout};
+		proximitySamples.wait(&timeout);
+		uint8_t sample;
+		while (proximitySamples.pop(sample))
+		{
+			chart.add_sample(lcd, sample);
+		}
+		sonata::thread_stats_checkpoint();
+	}
+}
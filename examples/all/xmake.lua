@@ -4,18 +4,23 @@
 compartment("led_walk_raw")
     add_deps("debug")
     add_files("led_walk_raw.cc")
+    instrumented()
 
 compartment("echo")
     add_files("echo.cc")
+    instrumented()
 
 compartment("lcd_test")
-    add_deps("lcd")
+    add_deps("lcd_service")
     add_files("lcd_test.cc")
+    instrumented()
 
 compartment("i2c_example")
-    add_deps("debug")
+    add_deps("debug", "async_log")
     add_files("i2c_example.cc")
+    instrumented()
 
 compartment("proximity_sensor_example")
-    add_deps("debug")
+    add_deps("debug", "async_log", "lcd_service")
     add_files("proximity_sensor_example.cc")
+    instrumented()
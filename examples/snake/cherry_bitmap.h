@@ -22,10 +22,3 @@ static uint8_t __attribute__((aligned(4))) cherryImage10x10[] = {
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
   0x00, 0x00, 0x00, 0x00, 0x00,
 };
-
-static uint8_t __attribute__((aligned(4))) cherryImage5x5[] = {
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00,
-  0x06, 0x00, 0x06, 0x00, 0x06, 0x00, 0x00, 0x00, 0xC0, 0x00, 0xC0, 0x00, 0x00,
-  0x00, 0xC0, 0x00, 0x06, 0x00, 0x00, 0x00, 0xC0, 0x00, 0x00, 0x00, 0xC0, 0x00,
-  0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC0, 0x00, 0x00,
-};
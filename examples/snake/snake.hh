@@ -0,0 +1,805 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <cheri.hh>
+#include <compartment.h>
+#include <debug.hh>
+#include <platform-entropy.hh>
+#include <platform-gpio.hh>
+#include <thread.h>
+#include <vector>
+
+#include "../../libraries/format.hh"
+#include "../../libraries/heap_stats.hh"
+#include "../../libraries/lcd.hh"
+#include "../../libraries/prng.hh"
+#include "../../libraries/tile_map.hh"
+#include "cherry_bitmap.h"
+
+using Debug = ConditionalDebug<true, "Snake">;
+using namespace sonata::lcd;
+using namespace CHERI;
+
+// Control game speed
+static constexpr uint32_t MillisecondsPerFrame = 400;
+// Small wait between games to avoid accidentally starting the next
+static constexpr uint32_t StartMenuWaitMilliseconds = 400;
+
+// Snake speeds up as it gets longer if enabled
+static constexpr bool SpeedScalingEnabled = true;
+// If enabled, all joystick motions start the game (not just a press)
+static constexpr bool StartOnAnyInput = true;
+// If enabled, displays a cherry bitmap scaled to the tile size for the fruit
+// instead of a green square.
+static constexpr bool UseCherryImage = true;
+// If enabled, shows the current score above the game, redrawing only the
+// digits that change.
+static constexpr bool ShowLiveScore = true;
+
+// Change colour of game elements
+static constexpr Color BackgroundColor = Color::Black,
+                       BorderColor     = Color::White,
+                       ForegroundColor = Color::White, SnakeColor = Color::Red;
+// Change the size of game elements (will automatically fit display)
+static constexpr Size TileSize = {10, 10}, TileSpacing = {2, 2},
+                      BorderSize = {4, 3};
+// The resolution of Sonata's display, from which the largest game, in tiles,
+// and so the size of the display's tile map, is worked out.
+static constexpr Size   DisplayResolution = {160, 128};
+static constexpr size_t MaxGameColumns =
+  (DisplayResolution.width - BorderSize.width * 2) /
+  (TileSize.width + TileSpacing.width);
+static constexpr size_t MaxGameRows =
+  (DisplayResolution.height - BorderSize.height * 2) /
+  (TileSize.height + TileSpacing.height);
+
+typedef struct Position
+{
+	int32_t x;
+	int32_t y;
+} Position;
+
+enum class Direction
+{
+	UP    = 0,
+	RIGHT = 1,
+	DOWN  = 2,
+	LEFT  = 3
+};
+
+// The allocator rounds heap allocations to a multiple of 8 bytes.
+// Tile is a uint64_t so the allocated game space array is guaranteed to be a
+// multiple of 8 bytes, as otherwise some out of bounds accesses will not be
+// appropriately caught. Each tile's value is also the index of its style in
+// the display's tile map.
+enum class Tile : uint64_t
+{
+	EMPTY,
+	SNAKE,
+	FRUIT,
+	COUNT
+};
+static constexpr size_t TileKinds = static_cast<size_t>(Tile::COUNT);
+
+// How the game detects the snake hitting the game's boundaries or itself.
+enum class CollisionPolicy
+{
+	// Let the out of bounds access fault, and recover from the CHERI
+	// capability violation in the compartment's error handler.
+	Trap,
+	// Check the snake's next position against the game's bounds first, so
+	// that nothing faults.
+	BoundsCheck
+};
+
+/**
+ * A game of snake for Sonata, using Cheri capability violations to detect when
+ * the snake reaches the game's boundaries. With the `BoundsCheck` collision
+ * policy, an explicit check is used instead.
+ *
+ * The game draws to a `Display`, normally `SonataLcd`, and reads the joystick
+ * from an `Input`, normally `volatile SonataGPIO`, so that it can also be run
+ * headless against stand-ins. `run_game` plays a game in real time; the
+ * `start_game`, `advance`, `render` and `end_game` steps that it is made of
+ * are public so that a game can be driven frame by frame instead.
+ */
+template<typename Display,
+         typename Input,
+         CollisionPolicy Collisions = CollisionPolicy::Trap>
+class SnakeGame
+{
+	private:
+	bool   isFirstGame = true;
+	bool   lastGameWon = false;
+	Tile **gameSpace   = nullptr;
+
+	// Fruit positions come from a fast generator, seeded from the entropy
+	// source at the start of each game.
+	EntropySource entropy{};
+	sonata::Prng  prng;
+
+	// The cherry bitmap has a black background, which is left transparent so
+	// that only the cherry itself is drawn over the game's background.
+	static constexpr Color  CherryKeyColor = Color::Black;
+	static constexpr size_t MaxCherrySpans = 16;
+	Sprite                  cherrySprite   = {{10, 10}, cherryImage10x10};
+	SpriteSpan              cherrySpans[MaxCherrySpans];
+	size_t                  cherrySpanCount;
+
+	// The display's copy of the game space, which redraws only the tiles
+	// that change.
+	TileStyle                            tileStyles[TileKinds];
+	TileMap<MaxGameColumns, MaxGameRows> tiles;
+
+	// Menu text, which is erased when a game starts, and the live score,
+	// which stays on screen and is updated in place.
+	TextLabel startLabel, resultLabel, scoreLabel, playAgainLabel;
+	TextLabel liveScoreLabel;
+
+	// Set when the live score needs redrawing.
+	bool scoreChanged = true;
+
+	sonata::heap::Vector<Position> snakePositions;
+	Size                           gameSize, gamePadding;
+	Position                       fruitPosition, nextPosition;
+	Direction                      currentDirection, lastSeenDirection;
+
+	/**
+	 * @brief Calculate game size and padding information from defined constants
+	 * and display info.
+	 *
+	 * @param lcd The LCD that will be drawn to.
+	 */
+	void initialise_game_size(Display *lcd)
+	{
+		Rect screen =
+		  Rect::from_point_and_size(Point::ORIGIN, lcd->resolution());
+		// Room for the live score is taken from the top of the game area.
+		const uint32_t ScoreHeight = ShowLiveScore ? font_height() : 0;
+		Size displaySize = {screen.right - screen.left - BorderSize.width * 2,
+		                    screen.bottom - screen.top -
+		                      BorderSize.height * 2 - ScoreHeight};
+		Size spacedTileSize = {TileSize.width + TileSpacing.width,
+		                       TileSize.height + TileSpacing.height};
+		gameSize            = {displaySize.width / spacedTileSize.width,
+                    displaySize.height / spacedTileSize.height};
+		gamePadding         = {
+          displaySize.width % spacedTileSize.width + TileSpacing.width,
+          displaySize.height % spacedTileSize.height + TileSpacing.height};
+		gamePadding = {
+		  Point::ORIGIN.x + BorderSize.width + gamePadding.width / 2,
+		  Point::ORIGIN.y + BorderSize.height + ScoreHeight +
+		    gamePadding.height / 2};
+		Debug::log("Calculated game size based on settings: {}x{}",
+		           static_cast<int>(gameSize.width),
+		           static_cast<int>(gameSize.height));
+		Debug::Assert(gameSize.width <= MaxGameColumns &&
+		                gameSize.height <= MaxGameRows,
+		              "The game is too large for its tile map");
+		tiles = {gameSize,
+		         {gamePadding.width, gamePadding.height},
+		         TileSize,
+		         TileSpacing,
+		         BackgroundColor,
+		         tileStyles,
+		         TileKinds};
+	};
+
+	/**
+	 * @brief Sets the styles that the tile map draws each kind of tile with.
+	 * If UseCherryImage is set then fruit is drawn as the cherry bitmap,
+	 * with its transparent background showing the game's background;
+	 * otherwise it is a green square.
+	 */
+	void initialise_tile_styles()
+	{
+		tileStyles[static_cast<size_t>(Tile::EMPTY)] = {BackgroundColor};
+		tileStyles[static_cast<size_t>(Tile::SNAKE)] = {SnakeColor};
+		tileStyles[static_cast<size_t>(Tile::FRUIT)] =
+		  UseCherryImage ? TileStyle{BackgroundColor,
+		                             &cherrySprite,
+		                             CherryKeyColor,
+		                             cherrySpans,
+		                             cherrySpanCount}
+		                 : TileStyle{Color::Green};
+	}
+
+	/**
+	 * @brief Sets a tile in the game space, and in the tile map so that it
+	 * is redrawn by the next flush.
+	 *
+	 * @param position The integer tile position (x, y) to set.
+	 * @param tile The new contents of the tile.
+	 */
+	void set_tile(Position position, Tile tile)
+	{
+		gameSpace[position.y][position.x] = tile;
+		tiles.set(position.x, position.y, static_cast<uint8_t>(tile));
+	}
+
+	/**
+	 * @brief Places the menu and score text based on the display size.
+	 *
+	 * @param lcd The LCD that will be drawn to.
+	 */
+	void initialise_labels(Display *lcd)
+	{
+		Size  displaySize = lcd->resolution();
+		Point centre      = {displaySize.width / 2, displaySize.height / 2};
+		// Text sizes are hard-coded for now as `draw_str` always uses 16pt font
+		startLabel = {
+		  {centre.x - 60, centre.y}, BackgroundColor, ForegroundColor};
+		resultLabel = {
+		  {centre.x - 25, centre.y - 15}, BackgroundColor, ForegroundColor};
+		scoreLabel = {
+		  {centre.x - 31, centre.y - 5}, BackgroundColor, ForegroundColor};
+		playAgainLabel = {
+		  {centre.x - 65, centre.y + 5}, BackgroundColor, ForegroundColor};
+		liveScoreLabel = {{BorderSize.width + 1, BorderSize.height},
+		                  BackgroundColor,
+		                  ForegroundColor};
+	}
+
+	/**
+	 * @brief Shows the current score above the game, if it has changed. Only
+	 * the digits that have changed since it was last shown are redrawn.
+	 *
+	 * @param lcd The LCD that will be drawn to.
+	 */
+	void draw_live_score(Display *lcd)
+	{
+		if (!ShowLiveScore || !scoreChanged)
+		{
+			return;
+		}
+		scoreChanged = false;
+		char scoreStr[20];
+		sonata::format::format_to(
+		  scoreStr, "Score: {}", snakePositions.size() - 1);
+		liveScoreLabel.set_text(*lcd, scoreStr);
+	}
+
+	/**
+	 * @brief Erases the snake and fruit from the last game, leaving the rest
+	 * of the display as it is.
+	 *
+	 * @param lcd The LCD that will be drawn to.
+	 */
+	void erase_game(Display *lcd)
+	{
+		tiles.fill(static_cast<uint8_t>(Tile::EMPTY));
+		tiles.flush(*lcd);
+	}
+
+	/**
+	 * @brief Displays the "start game" menu, waiting for an input and
+	 * initialising a random seed based on the first user input.
+	 *
+	 * @param gpio The Sonata GPIO driver to use for I/O operations.
+	 * @param lcd The LCD that will be drawn to.
+	 */
+	void wait_for_start(Input *gpio, Display *lcd)
+	{
+		if (isFirstGame)
+		{
+			startLabel.set_text(*lcd,
+			                    StartOnAnyInput
+			                      ? "Move the joystick to start"
+			                      : "Press the joystick to start");
+		}
+		else
+		{
+			// Only the game's tiles need erasing; the border and the live
+			// score are left in place.
+			erase_game(lcd);
+			resultLabel.set_text(*lcd,
+			                     lastGameWon ? "You won!" : "Game over!");
+			lastGameWon = false;
+			char scoreStr[24];
+			sonata::format::format_to(
+			  scoreStr, "Your score: {}", snakePositions.size() - 1);
+			scoreLabel.set_text(*lcd, scoreStr);
+			playAgainLabel.set_text(*lcd,
+			                        StartOnAnyInput
+			                          ? "Move the joystick to play again..."
+			                          : "Press the joystick to play again...");
+			// Wait for a short time to avoid instantly starting the next game
+			// due to accidental user input
+			thread_millisecond_wait(StartMenuWaitMilliseconds);
+		}
+
+		// Busy-wait for a valid joystick input
+		SonataJoystick joystickInp, noInput = static_cast<SonataJoystick>(0x0);
+		bool           waitingForInput = true;
+		while (waitingForInput)
+		{
+			thread_millisecond_wait(50);
+			joystickInp = gpio->read_joystick();
+			if (!StartOnAnyInput && joystickInp == SonataJoystick::Pressed)
+			{
+				waitingForInput = false;
+			}
+			else if (StartOnAnyInput && joystickInp != noInput)
+			{
+				waitingForInput = false;
+			}
+		};
+		Debug::log("Input detected. Game starting...");
+		startLabel.clear(*lcd);
+		resultLabel.clear(*lcd);
+		scoreLabel.clear(*lcd);
+		playAgainLabel.clear(*lcd);
+
+		// Initialise Pseudo RNG based on cycle counter at time of first input
+		entropy.reseed();
+		prng.seed_from(entropy);
+	};
+
+	/**
+	 * @brief Compares the relevant bits of the input joystick state and the
+	 * given direction to determine if the joystick is held in that direction or
+	 * not.
+	 *
+	 * @param joystick The joystick GPIO input
+	 * @param direction The joystick direction to test for
+	 * @return true if the joystick is held in that direction, false otherwise.
+	 */
+	bool joystick_in_direction(SonataJoystick joystick,
+	                           SonataJoystick direction)
+	{
+		return (static_cast<uint8_t>(joystick) &
+		        static_cast<uint8_t>(direction)) > 0;
+	};
+
+	/**
+	 * @brief Reads the GPIO output to find the current joystick output, and
+	 * translates it into a relevant direction. Returns the previous direction
+	 * if no current output.
+	 *
+	 * @param gpio The Sonata GPIO driver to use for I/O operations.
+	 */
+	Direction read_joystick(Input *gpio)
+	{
+		SonataJoystick joystickState = gpio->read_joystick();
+		// The joystick can be in many possible directions - we check directions
+		// in order relative to the current direction so that input prioritises
+		// turning left/right over staying in the same direction. This avoids
+		// the issue of input priority for diagonal joystick inputs, and feels
+		// smoother to play.
+		Direction directions[4] = {
+		  Direction::UP, Direction::RIGHT, Direction::DOWN, Direction::LEFT};
+		SonataJoystick joystickStates[4] = {SonataJoystick::Up,
+		                                    SonataJoystick::Right,
+		                                    SonataJoystick::Down,
+		                                    SonataJoystick::Left};
+
+		uint8_t base;
+		for (base = 0; base < 4; base++)
+		{
+			if (currentDirection == directions[base])
+			{
+				break;
+			}
+		}
+
+		for (uint8_t offset = 1; offset <= 4; offset++)
+		{
+			if (offset == 2 && snakePositions.size() != 1)
+			{
+				continue; // Disallow moving in the opposite direction
+			}
+			uint8_t idx = (base + offset) % 4;
+			if (joystick_in_direction(joystickState, joystickStates[idx]))
+			{
+				return directions[idx];
+			}
+		}
+		return lastSeenDirection;
+	};
+
+	/**
+	 * @brief Busy waits for a given amount of time, constantly polling for any
+	 * joystick input and recording it to avoid inputs being eaten between
+	 * frames.
+	 *
+	 * @param milliseconds The time to wait for in milliseconds.
+	 * @param gpio The Sonata GPIO driver to use for I/O operations.
+	 */
+	void wait_with_input(uint32_t milliseconds, Input *gpio)
+	{
+		const uint32_t CyclesPerMillisecond = CPU_TIMER_HZ / 1000;
+		const uint32_t Cycles  = milliseconds * CyclesPerMillisecond;
+		const uint64_t Start   = rdcycle64();
+		uint64_t       end     = Start + Cycles;
+		uint64_t       current = Start;
+		while (end > current)
+		{
+			lastSeenDirection = read_joystick(gpio);
+			current           = rdcycle64();
+		}
+	};
+
+	/**
+	 * @brief Attempts to generate a new fruit at a random possible position in
+	 * the game.
+	 *
+	 * @return true if a fruit was successfuly generated, or false if it could
+	 * not be generated.
+	 */
+	bool generate_new_fruit()
+	{
+		if (gameSize.width * gameSize.height <= snakePositions.size())
+		{
+			return false; // Cannot generate a fruit - board is full
+		}
+		bool validPosition = false;
+		while (!validPosition)
+		{
+			fruitPosition = {static_cast<int32_t>(prng.below(gameSize.width)),
+			                 static_cast<int32_t>(prng.below(gameSize.height))};
+
+			validPosition = true;
+			for (const Position &partPosition : snakePositions)
+			{
+				if (partPosition.x == fruitPosition.x &&
+				    partPosition.y == fruitPosition.y)
+				{
+					validPosition = false;
+					break;
+				}
+			}
+		}
+		set_tile(fruitPosition, Tile::FRUIT);
+		return true;
+	}
+
+	/**
+	 * @brief Initialises information required for starting the game, including
+	 * the snake and fruit positions.
+	 */
+	void initialise_game()
+	{
+		// Allocate a non-contiguous 2D array storing the game (tile) space for
+		// collision checks, allowing Out Of Bounds memory accesses to trigger
+		// CHERI capability violations for scoring
+		gameSpace = sonata::heap::allocate_array<Tile *>(gameSize.height);
+		for (uint32_t y = 0; y < gameSize.height; y++)
+		{
+			gameSpace[y] = sonata::heap::allocate_array<Tile>(gameSize.width);
+		}
+
+		Position startPosition = {static_cast<int32_t>(gameSize.width / 2),
+		                          static_cast<int32_t>(gameSize.height / 2)};
+		snakePositions.clear();
+		snakePositions.push_back(startPosition);
+		set_tile(startPosition, Tile::SNAKE);
+		currentDirection = lastSeenDirection = Direction::RIGHT;
+		scoreChanged                         = true;
+		generate_new_fruit();
+	};
+
+	/**
+	 * @brief Draws the background (including the border) for the main game.
+	 *
+	 * @param lcd The LCD that will be drawn to.
+	 */
+	void draw_background(Display *lcd)
+	{
+		Size lcdSize = lcd->resolution();
+		lcd->clean(BorderColor);
+		lcd->fill_rect({BorderSize.width,
+		                BorderSize.height,
+		                lcdSize.width - BorderSize.width,
+		                lcdSize.height - BorderSize.height},
+		               BackgroundColor);
+	}
+
+	/**
+	 * @brief Checks whether the snake is colliding with anything (i.e. itself)
+	 * in the game's space. Also responsible for causing the Out of Bounds
+	 * accesses when hitting the game's boundary which trigger CHERI violations
+	 * for scoring.
+	 *
+	 * @return true if the snake is colliding, false otherwise.
+	 *
+	 * @note The attribute nextPosition is used to pass along the snake's
+	 * position instead of using a traditional argument to allow us to use the
+	 * CHERI capability mechanisms for scoring. By keeping a simple function and
+	 * ignoring caller/callee-saves responsibilities we can just change the PCC
+	 * address to a function of the same kind that returns True to continue
+	 * execution after an out of bounds access occurs.
+	 *
+	 * With the `BoundsCheck` policy, the position is checked against the
+	 * game's bounds and no out of bounds access is made.
+	 */
+	[[gnu::noinline]] bool check_if_colliding()
+	{
+		if constexpr (Collisions == CollisionPolicy::BoundsCheck)
+		{
+			if (nextPosition.x < 0 || nextPosition.y < 0 ||
+			    static_cast<uint32_t>(nextPosition.x) >= gameSize.width ||
+			    static_cast<uint32_t>(nextPosition.y) >= gameSize.height)
+			{
+				return true;
+			}
+			return gameSpace[nextPosition.y][nextPosition.x] == Tile::SNAKE;
+		}
+		if (gameSpace[nextPosition.y][nextPosition.x] == Tile::SNAKE)
+		{
+			// Cause an out of bounds access on purpose when the snake collides
+			// with itself so we can use CHERI violations for game scoring
+			return gameSpace[gameSize.height][gameSize.width] == Tile::SNAKE;
+		}
+		return false;
+	};
+
+	/**
+	 * @brief Updates the game's state by a frame, advancing the snake forward
+	 * by 1 step in the input/previous direction, and handling collision and
+	 * fruit-eating logic. Only the game's state is changed; `render` draws
+	 * the tiles that changed.
+	 *
+	 * @param gpio The input to read the joystick from.
+	 * @return true if the game is still active, false if the game is over.
+	 */
+	bool update_game_state(Input *gpio)
+	{
+		currentDirection = read_joystick(gpio);
+
+		int8_t dx, dy;
+		switch (currentDirection)
+		{
+			case Direction::UP:
+				dx = -1;
+				dy = 0;
+				break;
+			case Direction::RIGHT:
+				dx = 0;
+				dy = -1;
+				break;
+			case Direction::DOWN:
+				dx = 1;
+				dy = 0;
+				break;
+			case Direction::LEFT:
+				dx = 0;
+				dy = 1;
+		};
+
+		Position currentPosition = snakePositions.back();
+		nextPosition = {currentPosition.x + dx, currentPosition.y + dy};
+		if (check_if_colliding())
+		{
+			Debug::log("Snake collided with something - game over.");
+			return false;
+		}
+		snakePositions.push_back(nextPosition);
+		set_tile(nextPosition, Tile::SNAKE);
+
+		bool gameStillActive = true;
+		if (nextPosition.x != fruitPosition.x ||
+		    nextPosition.y != fruitPosition.y)
+		{
+			// If not eating a fruit, move the snake's tail
+			Position tailPosition = snakePositions.front();
+			set_tile(tailPosition, Tile::EMPTY);
+			snakePositions.erase(snakePositions.begin());
+		}
+		else
+		{
+			scoreChanged = true;
+			if (!generate_new_fruit())
+			{
+				Debug::log("Snake has filled the screen - game won!");
+				lastGameWon     = true;
+				gameStillActive = false;
+			}
+		}
+		return gameStillActive;
+	}
+
+	/**
+	 * @brief Runs the main game loop, updating the snake's movement and drawing
+	 * new information to the display, and regulates update/frame timing.
+	 *
+	 * @param gpio The Sonata GPIO driver to use for I/O operations
+	 * @param lcd The LCD that will be drawn to.
+	 */
+	void main_game_loop(Input *gpio, Display *lcd)
+	{
+		const uint32_t CyclesPerMillisecond = CPU_TIMER_HZ / 1000;
+		uint64_t       currentTime          = rdcycle64();
+
+		// Draw initial information (to be drawn on top of, rather than
+		// re-drawing each frame). The background was drawn when the game
+		// was created and the last game's tiles erased by the menu.
+		render(lcd);
+
+		bool gameStillActive = true;
+		while (gameStillActive)
+		{
+			uint64_t nextTime = rdcycle64();
+			uint64_t elapsedTimeMilliseconds =
+			  (nextTime - currentTime) / CyclesPerMillisecond;
+			uint64_t frameTime = MillisecondsPerFrame;
+			if (SpeedScalingEnabled)
+			{
+				// Scale the game's speed in an inverse relationship between
+				// MILLISECONDS_PER_FRAME and MILLISECONDS_PER_FRAME / 2
+				frameTime /= 2;
+				frameTime += (frameTime / snakePositions.size());
+			}
+			if (elapsedTimeMilliseconds < frameTime)
+			{
+				uint64_t remainingTime = frameTime - elapsedTimeMilliseconds;
+				wait_with_input(remainingTime, gpio);
+			}
+			currentTime = rdcycle64();
+
+			gameStillActive = update_game_state(gpio);
+			render(lcd);
+		}
+	};
+
+	/**
+	 * @brief Cleans up the non-contiguous 2D game space array used for
+	 * collision checking.
+	 */
+	void free_game_space()
+	{
+		for (size_t y = 0; y < gameSize.height; y++)
+		{
+			sonata::heap::free(gameSpace[y]);
+		}
+		sonata::heap::free(gameSpace);
+	}
+
+	public:
+	/**
+	 * @brief Plays a game of snake using the stored state as settings.
+	 *
+	 * @param gpio The Sonata GPIO driver to use for I/O operations.
+	 * @param lcd The LCD that will be drawn to.
+	 */
+	void run_game(Input *gpio, Display *lcd)
+	{
+		wait_for_start(gpio, lcd);
+		start_game();
+		main_game_loop(gpio, lcd);
+		end_game();
+	};
+
+	/**
+	 * @brief Sets up a new game, without drawing it or waiting for input.
+	 * The random number generator is not reseeded.
+	 */
+	void start_game()
+	{
+		initialise_game();
+	}
+
+	/**
+	 * @brief Advances the game by one frame, reading the joystick once.
+	 *
+	 * @param gpio The input to read the joystick from.
+	 * @return true if the game is still active, false if the game is over.
+	 */
+	bool advance(Input *gpio)
+	{
+		return update_game_state(gpio);
+	}
+
+	/**
+	 * @brief Draws everything that has changed since the last render.
+	 *
+	 * @param lcd The LCD that will be drawn to.
+	 */
+	void render(Display *lcd)
+	{
+		draw_live_score(lcd);
+		tiles.flush(*lcd);
+	}
+
+	/**
+	 * @brief Frees the state of a game that has finished.
+	 */
+	void end_game()
+	{
+		free_game_space();
+		gameSpace   = nullptr;
+		isFirstGame = false;
+	}
+
+	/// The size of the game, in tiles.
+	Size board_size() const
+	{
+		return gameSize;
+	}
+
+	/// The position of the snake's head.
+	Position head() const
+	{
+		return snakePositions.back();
+	}
+
+	/// The number of tiles that the snake covers.
+	size_t snake_length() const
+	{
+		return snakePositions.size();
+	}
+
+	/// Whether the last game to finish was won by filling the board.
+	bool won() const
+	{
+		return lastGameWon;
+	}
+
+	/**
+	 * @brief Constructor for a SnakeGame.
+	 *
+	 * @param lcd The LCD that the game will be drawn to.
+	 */
+	SnakeGame(Display *lcd)
+	{
+		initialise_game_size(lcd);
+		initialise_labels(lcd);
+		draw_background(lcd);
+		cherrySpanCount = cherrySprite.opaque_spans(
+		  CherryKeyColor, cherrySpans, MaxCherrySpans);
+		Debug::Assert(cherrySpanCount <= MaxCherrySpans,
+		              "The cherry bitmap needs {} spans, but only {} fit",
+		              static_cast<int>(cherrySpanCount),
+		              static_cast<int>(MaxCherrySpans));
+		initialise_tile_styles();
+		prng.seed_from(entropy);
+	};
+
+	~SnakeGame()
+	{
+		if (gameSpace != nullptr)
+		{
+			free_game_space();
+		}
+	};
+};
+
+/**
+ * @brief A minimal function used to replace SnakeGame::check_if_colliding for
+ * use in error recovery, letting us utilise RISC-V's capability violations with
+ * a single compartment as a scoring mechanism.
+ *
+ * @return True, always.
+ */
+[[gnu::noinline]] inline bool return_from_handled_error()
+{
+	return true;
+}
+
+/**
+ * @brief Handles any CHERI Capability Violation errors for a compartment
+ * playing snake, and should be called from its `compartment_error_handler`.
+ * If the error was a Bounds or Tag violation it assumes it is because of the
+ * incorrect memory access in SnakeGame::check_if_colliding and therefore it
+ * recovers the program and ends the game. Otherwise, this force unwinds and
+ * ends the program.
+ */
+inline ErrorRecoveryBehaviour handle_snake_error(ErrorState *frame,
+                                                 size_t      mtval)
+{
+	auto [exceptionCode, registerNumber] = extract_cheri_mtval(mtval);
+	if (exceptionCode == CauseCode::BoundsViolation ||
+	    exceptionCode == CauseCode::TagViolation)
+	{
+		// If an explicit out of bounds access occurs, or bounds are made
+		// invalid by some negative array access, we **assume** that this was
+		// caused by the SnakeGame::check_if_colliding function and that the
+		// snake has hit the boundary of the game and so the game should end.
+		frame->pcc = (void *)(&return_from_handled_error);
+		return ErrorRecoveryBehaviour::InstallContext;
+	}
+
+	Debug::log(
+	  "Unexpected CHERI Capability violation encountered. Stopping...");
+	return ErrorRecoveryBehaviour::ForceUnwind;
+}
@@ -0,0 +1,427 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "snake.hh"
+#include <iterator>
+#include <riscvreg.h>
+
+#include "../../libraries/perf_counters.hh"
+
+/**
+ * Runs snake headless, as fast as it will go, with the display and joystick
+ * replaced by stand-ins. The joystick is driven by an autopilot that follows
+ * a cycle through every tile, so a game fills the whole board, or by a
+ * recorded trace of joystick states. The cycles spent each frame on game
+ * logic and on rendering are reported as the snake grows, and the core's
+ * performance counters break each down by cause at the end of the game.
+ *
+ * Games are then steered into a wall with each collision policy, to compare
+ * the frame that ends a game by faulting and recovering in the error
+ * handler against one that ends it with a bounds check.
+ *
+ * Finally, drawing fruit positions from `sonata::Prng` is compared with
+ * drawing them from `EntropySource` directly, as the game used to.
+ */
+
+// Where the benchmark's joystick input comes from.
+enum class InputSource
+{
+	Autopilot,
+	Trace,
+};
+static constexpr InputSource Source = InputSource::Autopilot;
+
+// Stop after this many frames, in case the game can't be finished.
+static constexpr uint32_t MaxFrames = 20000;
+
+// The number of games steered into a wall with each collision policy.
+static constexpr uint32_t WallHitRounds = 16;
+
+// The number of random values drawn by each source compared.
+static constexpr uint32_t RandomDraws = 1024;
+
+// A recorded input trace, one joystick state per frame, replayed in a loop
+// when the source is `InputSource::Trace`.
+static constexpr SonataJoystick RecordedTrace[] = {
+  SonataJoystick::Up,    SonataJoystick::Up,   SonataJoystick::Right,
+  SonataJoystick::Right, SonataJoystick::Down, SonataJoystick::Down,
+  SonataJoystick::Down,  SonataJoystick::Left, SonataJoystick::Left,
+  SonataJoystick::Left,  SonataJoystick::Up,   SonataJoystick::Up,
+};
+
+/**
+ * A stand-in for `SonataLcd` that draws nothing, but makes image readers
+ * produce their pixels so that rendering costs everything but the SPI
+ * transfers.
+ */
+class HeadlessLcd
+{
+	uint8_t chunk[SonataLcd::ImageChunkSize];
+
+	public:
+	uint32_t windows = 0;
+	uint32_t pixels  = 0;
+
+	Size resolution()
+	{
+		return DisplayResolution;
+	}
+
+	void clean(Color color)
+	{
+		fill_rect(Rect::from_point_and_size(Point::ORIGIN, resolution()),
+		          color);
+	}
+
+	void fill_rect(Rect rect, Color color)
+	{
+		windows++;
+		pixels += (rect.right - rect.left) * (rect.bottom - rect.top);
+	}
+
+	void draw_char(Point point,
+	               char  character,
+	               Color background,
+	               Color foreground)
+	{
+		windows++;
+		pixels += glyph_width(character) * font_height();
+	}
+
+	void draw_sprite_scaled(Rect              rect,
+	                        Sprite            sprite,
+	                        const SpriteSpan *spans,
+	                        size_t            spanCount)
+	{
+		fill_rect(rect, Color::Black);
+	}
+
+	void draw_image_rgb565(Rect rect, ImageReader read, void *context)
+	{
+		const size_t Length =
+		  (rect.right - rect.left) * (rect.bottom - rect.top) * 2;
+		for (size_t offset = 0; offset < Length; offset += sizeof(chunk))
+		{
+			read(context,
+			     offset,
+			     chunk,
+			     std::min(Length - offset, sizeof(chunk)));
+		}
+		windows++;
+		pixels += Length / 2;
+	}
+};
+
+/**
+ * A stand-in for `SonataGPIO` whose joystick is set by the benchmark before
+ * each frame.
+ */
+struct ScriptedJoystick
+{
+	SonataJoystick state = SonataJoystick::Pressed;
+
+	SonataJoystick read_joystick()
+	{
+		return state;
+	}
+};
+
+template<CollisionPolicy Collisions = CollisionPolicy::Trap>
+using HeadlessSnake = SnakeGame<HeadlessLcd, ScriptedJoystick, Collisions>;
+
+/**
+ * Returns the tile after `position` on a cycle that visits every tile of
+ * the board. Rows are walked in alternating directions, leaving the first
+ * column free for the way back to the top, which needs an even number of
+ * rows; a board with an odd number is walked by columns instead. If both
+ * are odd, the last row is left out of the cycle.
+ */
+static Position next_on_cycle(Position position, Size board)
+{
+	const bool Transposed = board.height % 2 != 0 && board.width % 2 == 0;
+	if (Transposed)
+	{
+		std::swap(position.x, position.y);
+		std::swap(board.width, board.height);
+	}
+	const int32_t Width = board.width;
+	const int32_t Rows  = board.height - board.height % 2;
+
+	Position next = position;
+	if (position.x == 0)
+	{
+		next = position.y == 0 ? Position{1, 0} : Position{0, position.y - 1};
+	}
+	else if (position.y % 2 == 0)
+	{
+		next = position.x < Width - 1 ? Position{position.x + 1, position.y}
+		                              : Position{position.x, position.y + 1};
+	}
+	else if (position.x > 1)
+	{
+		next = {position.x - 1, position.y};
+	}
+	else
+	{
+		next = position.y == Rows - 1 ? Position{0, position.y}
+		                              : Position{position.x, position.y + 1};
+	}
+
+	if (Transposed)
+	{
+		std::swap(next.x, next.y);
+	}
+	return next;
+}
+
+/**
+ * Returns the joystick state that moves the snake's head from `from` to the
+ * adjacent tile `to`, following the game's mapping of joystick directions
+ * to board axes.
+ */
+static SonataJoystick joystick_towards(Position from, Position to)
+{
+	if (to.x < from.x)
+	{
+		return SonataJoystick::Up;
+	}
+	if (to.x > from.x)
+	{
+		return SonataJoystick::Down;
+	}
+	return to.y < from.y ? SonataJoystick::Right : SonataJoystick::Left;
+}
+
+/**
+ * Cycle counts for a group of frames.
+ */
+struct FrameCosts
+{
+	uint32_t frames        = 0;
+	uint64_t logicTotal    = 0;
+	uint64_t renderTotal   = 0;
+	uint32_t logicMaximum  = 0;
+	uint32_t renderMaximum = 0;
+
+	void add(uint32_t logic, uint32_t render)
+	{
+		frames++;
+		logicTotal += logic;
+		renderTotal += render;
+		logicMaximum  = std::max(logicMaximum, logic);
+		renderMaximum = std::max(renderMaximum, render);
+	}
+
+	void report(const char *label, size_t length)
+	{
+		if (frames == 0)
+		{
+			return;
+		}
+		Debug::log("{} {}: {} frames, logic mean {} max {}, "
+		           "render mean {} max {} cycles",
+		           label,
+		           static_cast<int>(length),
+		           static_cast<int>(frames),
+		           static_cast<int>(logicTotal / frames),
+		           static_cast<int>(logicMaximum),
+		           static_cast<int>(renderTotal / frames),
+		           static_cast<int>(renderMaximum));
+	}
+};
+
+/**
+ * @brief Handles any CHERI Capability Violation errors, using them to detect
+ * the snake hitting the game's boundaries.
+ */
+extern "C" ErrorRecoveryBehaviour
+compartment_error_handler(ErrorState *frame, size_t mcause, size_t mtval)
+{
+	return handle_snake_error(frame, mtval);
+}
+
+/**
+ * Plays one game, with input from `Source`, until it is won or lost, and
+ * reports the cost of its frames as the snake grows.  Returns the size of
+ * the board.
+ */
+static Size benchmark_game(HeadlessLcd &lcd, ScriptedJoystick &joystick)
+{
+	HeadlessSnake<> game{&lcd};
+
+	game.start_game();
+	game.render(&lcd);
+	Debug::log("Benchmarking a {}x{} board",
+	           static_cast<int>(game.board_size().width),
+	           static_cast<int>(game.board_size().height));
+
+	FrameCosts            sinceGrowth, total;
+	sonata::perf::Section logic{"logic"}, render{"render"};
+	size_t                length      = game.snake_length();
+	uint32_t              frame       = 0;
+	bool                  stillActive = true;
+	while (stillActive && frame < MaxFrames)
+	{
+		if constexpr (Source == InputSource::Autopilot)
+		{
+			const Position Head = game.head();
+			joystick.state =
+			  joystick_towards(Head, next_on_cycle(Head, game.board_size()));
+		}
+		else
+		{
+			joystick.state =
+			  RecordedTrace[frame % std::size(RecordedTrace)];
+		}
+
+		const uint64_t Start = rdcycle64();
+		{
+			sonata::perf::ScopedRegion region{logic};
+			stillActive = game.advance(&joystick);
+		}
+		const uint64_t Logic = rdcycle64();
+		{
+			sonata::perf::ScopedRegion region{render};
+			game.render(&lcd);
+		}
+		const uint64_t End = rdcycle64();
+
+		sinceGrowth.add(Logic - Start, End - Logic);
+		total.add(Logic - Start, End - Logic);
+		frame++;
+
+		if (game.snake_length() != length)
+		{
+			sinceGrowth.report("Length", length);
+			sinceGrowth = {};
+			length      = game.snake_length();
+		}
+	}
+	sinceGrowth.report("Length", length);
+
+	Debug::log("Game {} after {} frames, length {}",
+	           game.won() ? "won" : "over",
+	           static_cast<int>(frame),
+	           static_cast<int>(game.snake_length()));
+	total.report("Whole game, final length", game.snake_length());
+	Debug::log("Rendering made {} window writes of {} pixels in total",
+	           static_cast<int>(lcd.windows),
+	           static_cast<int>(lcd.pixels));
+	// The mean counts of each event per frame.
+	char report[256];
+	for (const sonata::perf::Section *section : {&logic, &render})
+	{
+		section->report(report, sizeof(report));
+		Debug::log("{}", report);
+	}
+	game.end_game();
+	// The game's allocations, all of which should have been freed.
+	sonata::heap::report(report, sizeof(report));
+	Debug::log("{}", report);
+	return game.board_size();
+}
+
+/**
+ * Steers `WallHitRounds` games straight into the top wall with the
+ * `Collisions` policy, and reports the logic cost of the frames that ended
+ * them against that of the frames before.
+ */
+template<CollisionPolicy Collisions>
+static void benchmark_wall_hits(HeadlessLcd      &lcd,
+                                ScriptedJoystick &joystick,
+                                const char       *label)
+{
+	HeadlessSnake<Collisions> game{&lcd};
+
+	FrameCosts moving, colliding;
+	for (uint32_t round = 0; round < WallHitRounds; round++)
+	{
+		game.start_game();
+		game.render(&lcd);
+		joystick.state   = SonataJoystick::Up;
+		bool stillActive = true;
+		for (uint32_t frame = 0; stillActive && frame < MaxFrames; frame++)
+		{
+			const uint64_t Start = rdcycle64();
+			stillActive          = game.advance(&joystick);
+			const uint64_t Logic = rdcycle64();
+			if (stillActive)
+			{
+				game.render(&lcd);
+				moving.add(Logic - Start, rdcycle64() - Logic);
+			}
+			else
+			{
+				colliding.add(Logic - Start, 0);
+			}
+		}
+		game.end_game();
+	}
+	Debug::log("{}: moving frames' logic mean {} max {}, "
+	           "colliding frames' logic mean {} max {} cycles",
+	           label,
+	           static_cast<int>(moving.logicTotal /
+	                            std::max(moving.frames, 1U)),
+	           static_cast<int>(moving.logicMaximum),
+	           static_cast<int>(colliding.logicTotal /
+	                            std::max(colliding.frames, 1U)),
+	           static_cast<int>(colliding.logicMaximum));
+}
+
+/**
+ * Compares the cost of drawing random columns of a board `width` tiles wide
+ * from `EntropySource`, reduced with `%`, with that of drawing them from
+ * `sonata::Prng`, one at a time and in bulk.
+ */
+static void benchmark_random(uint32_t width)
+{
+	EntropySource entropy;
+	sonata::Prng  prng;
+	prng.seed_from(entropy);
+	// Accumulate the draws, so that they can't be optimised away.
+	uint32_t sum = 0;
+
+	uint64_t start = rdcycle64();
+	for (uint32_t i = 0; i < RandomDraws; i++)
+	{
+		sum += static_cast<uint32_t>(entropy() % width);
+	}
+	const uint64_t Direct = rdcycle64() - start;
+
+	start = rdcycle64();
+	for (uint32_t i = 0; i < RandomDraws; i++)
+	{
+		sum += prng.below(width);
+	}
+	const uint64_t Bounded = rdcycle64() - start;
+
+	uint32_t words[64];
+	start = rdcycle64();
+	for (uint32_t i = 0; i < RandomDraws; i += std::size(words))
+	{
+		prng.fill(words, std::size(words));
+		sum += words[0];
+	}
+	const uint64_t Bulk = rdcycle64() - start;
+
+	Debug::log("Random values below {}, in cycles each: EntropySource with % "
+	           "{}, Prng::below {}, Prng::fill {} (checksum {})",
+	           static_cast<int>(width),
+	           static_cast<int>(Direct / RandomDraws),
+	           static_cast<int>(Bounded / RandomDraws),
+	           static_cast<int>(Bulk / RandomDraws),
+	           static_cast<int>(sum));
+}
+
+// Thread entry point.
+void __cheri_compartment("snake_benchmark") snake_benchmark()
+{
+	HeadlessLcd      lcd;
+	ScriptedJoystick joystick;
+
+	const Size Board = benchmark_game(lcd, joystick);
+	benchmark_wall_hits<CollisionPolicy::Trap>(lcd, joystick, "Trap");
+	benchmark_wall_hits<CollisionPolicy::BoundsCheck>(
+	  lcd, joystick, "Bounds check");
+	benchmark_random(Board.width);
+}
@@ -15,6 +15,28 @@ firmware("snake_demo")
                 priority = 2,
                 entry_point = "snake",
                 stack_size = 0x1000,
+                trusted_stack_frames = 3
+            }
+        }, {expand = false})
+    end)
+    after_link(convert_to_uf2)
+
+-- Runs snake headless with an autopilot, reporting the cycles spent per
+-- frame on game logic and rendering.
+compartment("snake_benchmark")
+  add_deps("lcd", "debug")
+  add_files("snake_benchmark.cc")
+
+firmware("snake_benchmark")
+    add_deps("freestanding", "snake_benchmark")
+    on_load(function(target)
+        target:values_set("board", "$(board)")
+        target:values_set("threads", {
+            {
+                compartment = "snake_benchmark",
+                priority = 2,
+                entry_point = "snake_benchmark",
+                stack_size = 0x1000,
                 trusted_stack_frames = 2
             }
         }, {expand = false})
@@ -7,20 +7,163 @@ includes(sdkdir)
 set_toolchains("cheriot-clang")
 
 includes(path.join(sdkdir, "lib"))
-includes("../libraries")
 includes("../common.lua")
+includes("../libraries")
 
 option("board")
     set_default("sonata-prerelease")
 
+-- Send the lines logged with sonata::log as binary records, to be decoded
+-- on the host by scripts/token_log_decoder.py, rather than as text.
+option("tokenised-log")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Log with tokens instead of format strings")
+option_end()
+
+if has_config("tokenised-log") then
+    add_defines("SONATA_TOKENISED_LOG")
+end
+
+-- Instrument the example compartments and run the sampling profiler in each
+-- firmware, for scripts/profile_report.py.
+option("profile")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Build with the sampling profiler")
+option_end()
+
+-- Account for the cycles run by each thread and for idle time, printed once a
+-- second. Needs the RTOS's scheduler accounting, so build with
+-- --scheduler-accounting=y as well.
+option("thread-stats")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Build with per-thread CPU time accounting")
+option_end()
+
+if has_config("thread-stats") then
+    add_defines("SONATA_THREAD_STATS")
+end
+
+-- Measure how deep each thread's stack grows in the instrumented
+-- compartments, printed every ten seconds for scripts/stack_report.py.
+option("stack-usage")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Build with stack depth measurement")
+option_end()
+
+-- Threads that only write out what others have produced, the async_log drain
+-- and the profiler's writer, run at the lowest priority. They share it with
+-- echo, which never blocks, so that they aren't starved by it.
+local writerPriority = 1
+
+-- Returns the thread that writes out the lines logged through async_log.
+local function async_log_drain_thread()
+    return {
+        compartment = "async_log",
+        priority = writerPriority,
+        entry_point = "async_log_drain",
+        stack_size = 0x300,
+        trusted_stack_frames = 2
+    }
+end
+
+local profiling = has_config("profile")
+local threadStats = has_config("thread-stats")
+local stackUsage = has_config("stack-usage")
+
+-- Adds the profiler, thread_stats and stack_usage compartments to the firmware
+-- being described, as configured, and async_log, which the last two log
+-- through.
+local function instrumentation_deps()
+    if profiling then
+        add_deps("profiler")
+    end
+    if threadStats then
+        add_deps("thread_stats")
+    end
+    if stackUsage then
+        add_deps("stack_usage")
+    end
+    if threadStats or stackUsage then
+        add_deps("async_log")
+    end
+end
+
+-- Adds the threads, and shared state, of the profiler, thread_stats and
+-- stack_usage to a firmware's threads, as configured, along with the async_log
+-- drain if they need it and the firmware has none. Each must preempt the
+-- threads it observes, except the writers.
+local function with_instrumentation(target, threads)
+    local sharedObjects = {}
+    local hasDrain = false
+    for _, thread in ipairs(threads) do
+        if thread.entry_point == "async_log_drain" then
+            hasDrain = true
+        end
+    end
+    if threadStats then
+        -- A checkpoint calls thread_stats, which calls the scheduler.
+        for _, thread in ipairs(threads) do
+            thread.trusted_stack_frames = thread.trusted_stack_frames + 2
+        end
+        table.insert(threads, {
+            compartment = "thread_stats",
+            priority = 19,
+            entry_point = "thread_stats_report",
+            stack_size = 0x400,
+            trusted_stack_frames = 2
+        })
+    end
+    if profiling then
+        table.insert(threads, {
+            compartment = "profiler",
+            priority = 20,
+            entry_point = "profiler_run",
+            stack_size = 0x400,
+            trusted_stack_frames = 2
+        })
+        table.insert(threads, {
+            compartment = "profiler",
+            priority = writerPriority,
+            entry_point = "profiler_write",
+            stack_size = 0x400,
+            trusted_stack_frames = 2
+        })
+        -- Must match ProfilerStateSize in libraries/profiler.hh.
+        sharedObjects.profiler_state = 552
+    end
+    if stackUsage then
+        table.insert(threads, {
+            compartment = "stack_usage",
+            priority = 18,
+            entry_point = "stack_usage_report",
+            stack_size = 0x300,
+            trusted_stack_frames = 2
+        })
+        -- Must match StackUsageStateSize in libraries/stack_usage.hh.
+        sharedObjects.stack_usage_state = 64
+    end
+    if (threadStats or stackUsage) and not hasDrain then
+        table.insert(threads, async_log_drain_thread())
+    end
+    if next(sharedObjects) ~= nil then
+        target:values_set("shared_objects", sharedObjects, {expand = false})
+    end
+    return threads
+end
+
 includes("all", "snake")
 
 -- A simple demo using only devices on the Sonata board
 firmware("sonata_simple_demo")
     add_deps("freestanding", "led_walk_raw", "echo", "lcd_test")
+    instrumentation_deps()
     on_load(function(target)
         target:values_set("board", "$(board)")
-        target:values_set("threads", {
+        target:values_set("threads", with_instrumentation(target, {
             {
                 compartment = "led_walk_raw",
                 priority = 2,
@@ -35,23 +178,31 @@ firmware("sonata_simple_demo")
                 stack_size = 0x200,
                 trusted_stack_frames = 1
             },
+            {
+                compartment = "lcd_service",
+                priority = 3,
+                entry_point = "lcd_service_init",
+                stack_size = 0x800,
+                trusted_stack_frames = 3
+            },
             {
                 compartment = "lcd_test",
                 priority = 2,
                 entry_point = "lcd_test",
                 stack_size = 0x1000,
-                trusted_stack_frames = 1
+                trusted_stack_frames = 4
             }
-        }, {expand = false})
+        }), {expand = false})
     end)
     after_link(convert_to_uf2)
 
 -- A demo that expects additional devices such as I2C devices
 firmware("sonata_demo_everything")
     add_deps("freestanding", "led_walk_raw", "echo", "lcd_test", "i2c_example")
+    instrumentation_deps()
     on_load(function(target)
         target:values_set("board", "$(board)")
-        target:values_set("threads", {
+        target:values_set("threads", with_instrumentation(target, {
             {
                 compartment = "led_walk_raw",
                 priority = 2,
@@ -66,30 +217,39 @@ firmware("sonata_demo_everything")
                 stack_size = 0x200,
                 trusted_stack_frames = 1
             },
+            {
+                compartment = "lcd_service",
+                priority = 3,
+                entry_point = "lcd_service_init",
+                stack_size = 0x800,
+                trusted_stack_frames = 3
+            },
             {
                 compartment = "lcd_test",
                 priority = 2,
                 entry_point = "lcd_test",
                 stack_size = 0x1000,
-                trusted_stack_frames = 1
+                trusted_stack_frames = 4
             },
             {
                 compartment = "i2c_example",
                 priority = 2,
                 entry_point = "run",
                 stack_size = 0x300,
-                trusted_stack_frames = 1
-            }
-        }, {expand = false})
+                trusted_stack_frames = 2
+            },
+            async_log_drain_thread()
+        }), {expand = false})
     end)
     after_link(convert_to_uf2)
 
 -- Demo that does proximity test as well as LCD screen, etc for demos.
 firmware("sonata_proximity_demo")
     add_deps("freestanding", "led_walk_raw", "echo", "lcd_test", "proximity_sensor_example")
+    instrumentation_deps()
     on_load(function(target)
         target:values_set("board", "$(board)")
-        target:values_set("threads", {
+        target:values_set("threads", with_instrumentation(target, {
             {
                 compartment = "led_walk_raw",
                 priority = 2,
@@ -104,36 +264,53 @@ firmware("sonata_proximity_demo")
                 stack_size = 0x200,
                 trusted_stack_frames = 1
             },
+            {
+                compartment = "lcd_service",
+                priority = 3,
+                entry_point = "lcd_service_init",
+                stack_size = 0x800,
+                trusted_stack_frames = 3
+            },
             {
                 compartment = "lcd_test",
                 priority = 2,
                 entry_point = "lcd_test",
                 stack_size = 0x1000,
-                trusted_stack_frames = 1
+                trusted_stack_frames = 4
             },
             {
                 compartment = "proximity_sensor_example",
                 priority = 2,
                 entry_point = "run",
-                stack_size = 0x200,
-                trusted_stack_frames = 1
-            }
-        }, {expand = false})
+                stack_size = 0x400,
+                trusted_stack_frames = 3
+            },
+            {
+                compartment = "proximity_sensor_example",
+                priority = 1,
+                entry_point = "run_graph",
+                stack_size = 0x400,
+                trusted_stack_frames = 4
+            },
+            async_log_drain_thread()
+        }), {expand = false})
     end)
     after_link(convert_to_uf2)
 
 firmware("proximity_test")
     add_deps("freestanding", "proximity_sensor_example")
+    instrumentation_deps()
     on_load(function(target)
         target:values_set("board", "$(board)")
-        target:values_set("threads", {
+        target:values_set("threads", with_instrumentation(target, {
             {
                 compartment = "proximity_sensor_example",
                 priority = 2,
                 entry_point = "run",
-                stack_size = 0x200,
-                trusted_stack_frames = 1
-            }
-        }, {expand = false})
+                stack_size = 0x400,
+                trusted_stack_frames = 3
+            },
+            async_log_drain_thread()
+        }), {expand = false})
     end)
     after_link(convert_to_uf2)
@@ -7,8 +7,8 @@ includes(sdkdir)
 set_toolchains("cheriot-clang")
 
 includes(path.join(sdkdir, "lib"))
-includes("../libraries")
 includes("../common.lua")
+includes("../libraries")
 
 option("board")
     set_default("sonata-prerelease")
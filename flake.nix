@@ -38,8 +38,12 @@
 
       inherit (pkgs.lib) fileset getExe;
 
+      sizeCheckFiles = fileset.unions [./scripts/size_report.py ./size_budget.toml];
+
       commonSoftwareBuildAttributes = {
-        buildInputs = cheriotPkgs ++ [lrPkgs.uf2conv];
+        # Python runs scripts/size_report.py, which checks each firmware
+        # against its budget in size_budget.toml.
+        buildInputs = cheriotPkgs ++ [lrPkgs.uf2conv pkgs.python3];
         installPhase = ''
           mkdir -p $out/share/
           cp build/cheriot/cheriot/release/* $out/share/
@@ -61,7 +65,7 @@
           name = "sonata-tests";
           src = fileset.toSource {
             root = ./.;
-            fileset = fileset.unions [./tests ./common.lua ./cheriot-rtos];
+            fileset = fileset.unions [./tests ./common.lua ./cheriot-rtos sizeCheckFiles];
           };
           buildPhase = "xmake -P ./tests/";
         }
@@ -74,6 +78,7 @@
             fileset = fileset.unions [
               ./common.lua
               ./cheriot-rtos
+              sizeCheckFiles
               ./libraries
               ./third_party
               ./examples
@@ -87,7 +92,7 @@
           name = "sonata-exercises";
           src = fileset.toSource {
             root = ./.;
-            fileset = fileset.unions [./exercises ./common.lua ./cheriot-rtos];
+            fileset = fileset.unions [./exercises ./common.lua ./cheriot-rtos sizeCheckFiles];
           };
           buildPhase = "xmake -P ./exercises/";
         }
@@ -0,0 +1,69 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "asset_store.hh"
+#include <string.h>
+
+using namespace sonata::flash;
+
+/// The size of the store's header.
+static constexpr size_t HeaderSize = 8;
+/// The size of each index entry.
+static constexpr size_t EntrySize = 32;
+
+/**
+ * Helper.  Returns the little-endian value of `size` bytes at `bytes`.
+ */
+static uint32_t little_endian(const uint8_t *bytes, size_t size)
+{
+	uint32_t value = 0;
+	for (size_t i = size; i > 0; i--)
+	{
+		value = (value << 8) | bytes[i - 1];
+	}
+	return value;
+}
+
+bool __cheri_libcall AssetStore::open()
+{
+	uint8_t header[HeaderSize];
+	flash.read(base, header, sizeof(header));
+	flash.end_read();
+	if (little_endian(header, 4) != Magic)
+	{
+		count = 0;
+		return false;
+	}
+	count = little_endian(header + 4, 4);
+	return true;
+}
+
+std::optional<Asset> __cheri_libcall AssetStore::find(const char *name)
+{
+	if (strlen(name) > MaxNameLength)
+	{
+		return std::nullopt;
+	}
+	std::optional<Asset> found;
+	uint8_t              entry[EntrySize];
+	// The entries are read in order, so the flash's read command continues
+	// from one to the next.
+	for (uint32_t i = 0; i < count; i++)
+	{
+		flash.read(base + HeaderSize + i * EntrySize, entry, sizeof(entry));
+		if (strncmp(reinterpret_cast<const char *>(entry),
+		            name,
+		            MaxNameLength + 1) != 0)
+		{
+			continue;
+		}
+		found = Asset{base + little_endian(entry + 16, 4),
+		              little_endian(entry + 20, 4),
+		              static_cast<uint16_t>(little_endian(entry + 24, 2)),
+		              static_cast<uint16_t>(little_endian(entry + 26, 2)),
+		              static_cast<AssetFormat>(little_endian(entry + 28, 2))};
+		break;
+	}
+	flash.end_read();
+	return found;
+}
@@ -0,0 +1,122 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <optional>
+
+#include "lcd.hh"
+#include "spi_flash.hh"
+
+namespace sonata::flash
+{
+	/// The formats of asset data.
+	enum class AssetFormat : uint16_t
+	{
+		Raw    = 0,
+		Rgb565 = 1,
+	};
+
+	/**
+	 * An asset found in the store's index.  Images are stored as for
+	 * `SonataLcd::draw_image_rgb565`; other assets have no size.
+	 */
+	struct Asset
+	{
+		/// The offset of the asset's data from the start of the flash.
+		uint32_t    offset;
+		uint32_t    length;
+		uint16_t    width;
+		uint16_t    height;
+		AssetFormat format;
+	};
+
+	/**
+	 * Read-only access to assets packed into the SPI flash by
+	 * `scripts/pack_assets.py`.  The store starts with an 8-byte header, the
+	 * magic number and the number of assets, followed by a 32-byte index
+	 * entry per asset: a null-padded 16-byte name, then the data's offset
+	 * from the start of the store and its length, then the width, height
+	 * and format as 16-bit values, and two bytes of padding.  All values
+	 * are little endian.
+	 */
+	class AssetStore
+	{
+		public:
+		/// The magic number at the start of the store, "SAST".
+		static constexpr uint32_t Magic = 0x54534153;
+		/// The default offset of the store in the flash.
+		static constexpr uint32_t DefaultBase = 0x0;
+		/// The longest asset name.
+		static constexpr size_t MaxNameLength = 15;
+
+		private:
+		SpiFlash &flash;
+		uint32_t  base;
+		uint32_t  count = 0;
+
+		public:
+		AssetStore(SpiFlash &flash, uint32_t base = DefaultBase)
+		  : flash(flash), base(base)
+		{
+		}
+
+		/**
+		 * Read the store's header.  Returns false if the flash does not
+		 * hold an asset store at this store's base.
+		 */
+		bool __cheri_libcall open();
+
+		/**
+		 * Look an asset up by name in the index.
+		 */
+		std::optional<Asset> __cheri_libcall find(const char *name);
+
+		/**
+		 * Read `length` bytes of an asset, starting `offset` bytes into its
+		 * data.  Reads past the end of the asset are truncated.
+		 */
+		void read(const Asset &asset,
+		          size_t       offset,
+		          uint8_t     *buffer,
+		          size_t       length)
+		{
+			if (offset >= asset.length)
+			{
+				return;
+			}
+			flash.read(asset.offset + offset,
+			           buffer,
+			           std::min(length, asset.length - offset));
+		}
+
+		/**
+		 * Draw an RGB565 image asset with its top-left corner at `point`,
+		 * streaming it from the flash to the display a chunk at a time
+		 * rather than copying it to memory.  Returns false if the asset is
+		 * not an image.
+		 */
+		bool draw(lcd::SonataLcd &lcd, lcd::Point point, const Asset &asset)
+		{
+			if (asset.format != AssetFormat::Rgb565 ||
+			    asset.length < 2u * asset.width * asset.height)
+			{
+				return false;
+			}
+			struct Source
+			{
+				AssetStore  *store;
+				const Asset *asset;
+			} source = {this, &asset};
+			lcd.draw_image_rgb565(
+			  lcd::Rect::from_point_and_size(point,
+			                                 {asset.width, asset.height}),
+			  [](void *context, size_t offset, uint8_t *buffer, size_t length) {
+				  auto *source = static_cast<Source *>(context);
+				  source->store->read(*source->asset, offset, buffer, length);
+			  },
+			  &source);
+			flash.end_read();
+			return true;
+		}
+	};
+} // namespace sonata::flash
@@ -0,0 +1,297 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "async_log.hh"
+#include <cheri.hh>
+#include <errno.h>
+#include <futex.h>
+#include <locks.hh>
+#include <platform-uart.hh>
+#include <thread.h>
+#include <timeout.hh>
+
+#include "uart_write.hh"
+
+/// The number of rings, each claimed by the first thread to log into it.
+static constexpr size_t MaxThreads = 8;
+
+/// The size of each thread's ring, in bytes; a power of two.
+static constexpr uint32_t RingBytes = 1024;
+static_assert((RingBytes & (RingBytes - 1)) == 0,
+              "The ring size must be a power of two");
+static_assert(AsyncLogMaxLine < 128 && AsyncLogMaxLine + 1 <= RingBytes,
+              "A line and its header byte must fit in a ring");
+
+/// Set in an entry's header byte if it is a binary record, not a line.
+static constexpr uint8_t BinaryRecord = 0x80;
+
+/**
+ * The lines logged by one thread, each stored as a header byte, holding its
+ * length and the `BinaryRecord` flag, followed by its bytes.  The thread is
+ * the only producer and the drain the only consumer, so, as in
+ * `SampleRing`, each index is written by one side and only read by the
+ * other.
+ */
+struct LogRing
+{
+	uint8_t  bytes[RingBytes];
+	/// The ID of the thread that claimed the ring, or zero if it is free.
+	uint16_t owner;
+	/// Count of bytes appended, written only by the producer.
+	uint32_t head;
+	/// Count of bytes written out, written only by the drain.
+	uint32_t tail;
+	/// Count of lines dropped, written only by the producer.
+	uint32_t dropped;
+	/// The value of `dropped` last reported, used only by the drain.
+	uint32_t droppedReported;
+	/// Non-zero while the producer is waiting on `tail` for room.
+	uint32_t producerWaiting;
+};
+
+static LogRing rings[MaxThreads];
+
+/// Serialises threads claiming rings; never held by the drain.
+static FlagLock claimLock;
+
+/**
+ * Set by producers after appending a line, and cleared by the drain before
+ * each pass over the rings, so that a line appended after a pass is never
+ * missed by the wait that follows it.
+ */
+static uint32_t doorbell;
+/// Non-zero while the drain is, or is about to be, waiting on `doorbell`.
+static uint32_t drainWaiting;
+
+/**
+ * Helper.  Returns the ring claimed by the thread with ID `threadId`, or
+ * nullptr if it hasn't claimed one.
+ */
+static LogRing *ring_for(uint16_t threadId)
+{
+	if (threadId == 0)
+	{
+		return nullptr;
+	}
+	for (LogRing &ring : rings)
+	{
+		if (__atomic_load_n(&ring.owner, __ATOMIC_ACQUIRE) == threadId)
+		{
+			return &ring;
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * Helper.  Returns the calling thread's ring, claiming a free one if it
+ * has none, or nullptr if every ring is claimed.  Rings are never given
+ * up, so a thread only takes the lock the first time it logs.
+ */
+static LogRing *claim_ring()
+{
+	const uint16_t Self = thread_id_get();
+	if (LogRing *ring = ring_for(Self))
+	{
+		return ring;
+	}
+	LockGuard guard{claimLock};
+	for (LogRing &ring : rings)
+	{
+		if (ring.owner == 0)
+		{
+			// The drain skips the ring until it sees the owner.
+			__atomic_store_n(&ring.owner, Self, __ATOMIC_RELEASE);
+			return &ring;
+		}
+	}
+	return nullptr;
+}
+
+/**
+ * Helper.  Returns whether an entry of `length` bytes fits in a ring with
+ * `head` bytes appended and `tail` written out.
+ */
+static bool has_room(uint32_t head, uint32_t tail, size_t length)
+{
+	return RingBytes - (head - tail) >= length + 1;
+}
+
+/**
+ * Helper.  Appends an entry of `length` bytes, which must be at most
+ * `AsyncLogMaxLine`, to the calling thread's ring and rings the doorbell,
+ * waiting up to `timeout` for the drain to make room if the ring is full.
+ */
+static int
+append(const uint8_t *data, size_t length, uint8_t flags, Timeout *timeout)
+{
+	LogRing *ring = claim_ring();
+	if (ring == nullptr)
+	{
+		return -ENOSPC;
+	}
+
+	const uint32_t Head = ring->head;
+	uint32_t       tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	if (!has_room(Head, tail, length) && timeout->may_block())
+	{
+		__atomic_store_n(&ring->producerWaiting, 1, __ATOMIC_SEQ_CST);
+		// Reload after announcing the wait, so that the drain either frees
+		// the room before the load or sees the flag and wakes us.
+		tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+		while (!has_room(Head, tail, length) && timeout->may_block())
+		{
+			futex_timed_wait(timeout, &ring->tail, tail);
+			tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+		}
+		__atomic_store_n(&ring->producerWaiting, 0, __ATOMIC_RELAXED);
+	}
+	if (!has_room(Head, tail, length))
+	{
+		__atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+		return -ENOSPC;
+	}
+	ring->bytes[Head % RingBytes] = static_cast<uint8_t>(length) | flags;
+	for (size_t i = 0; i < length; i++)
+	{
+		ring->bytes[(Head + 1 + i) % RingBytes] = data[i];
+	}
+	__atomic_store_n(&ring->head, Head + 1 + length, __ATOMIC_RELEASE);
+
+	__atomic_store_n(&doorbell, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&drainWaiting, __ATOMIC_SEQ_CST) != 0)
+	{
+		futex_wake(&doorbell, 1);
+	}
+	return 0;
+}
+
+int async_log_write(const char *message, size_t length)
+{
+	if (!CHERI::check_pointer(message, length))
+	{
+		return -EINVAL;
+	}
+	Timeout noWait{0};
+	return append(reinterpret_cast<const uint8_t *>(message),
+	              length < AsyncLogMaxLine ? length : AsyncLogMaxLine,
+	              0,
+	              &noWait);
+}
+
+int async_log_write_wait(Timeout *timeout, const char *message, size_t length)
+{
+	if (!CHERI::check_pointer(message, length) ||
+	    !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Load,
+	                                               CHERI::Permission::Store}>(
+	      timeout))
+	{
+		return -EINVAL;
+	}
+	return append(reinterpret_cast<const uint8_t *>(message),
+	              length < AsyncLogMaxLine ? length : AsyncLogMaxLine,
+	              0,
+	              timeout);
+}
+
+int async_log_write_record(const uint8_t *record, size_t length)
+{
+	if (length > AsyncLogMaxLine || !CHERI::check_pointer(record, length))
+	{
+		return -EINVAL;
+	}
+	Timeout noWait{0};
+	return append(record, length, BinaryRecord, &noWait);
+}
+
+uint32_t async_log_dropped(uint16_t threadId)
+{
+	if (threadId != 0)
+	{
+		LogRing *ring = ring_for(threadId);
+		return ring == nullptr
+		         ? 0
+		         : __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+	}
+	uint32_t total = 0;
+	for (LogRing &ring : rings)
+	{
+		total += __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED);
+	}
+	return total;
+}
+
+/**
+ * Helper.  Writes out every line in `ring`, followed by a note of any lines
+ * its thread has dropped since the last one, and wakes the thread if it is
+ * waiting for room.  Returns whether anything was written.
+ */
+static bool drain_ring(volatile OpenTitanUart *uart, LogRing &ring)
+{
+	bool           wrote = false;
+	const uint32_t Head  = __atomic_load_n(&ring.head, __ATOMIC_ACQUIRE);
+	uint32_t       tail  = ring.tail;
+	while (tail != Head)
+	{
+		const uint8_t  Header = ring.bytes[tail % RingBytes];
+		const uint32_t Length = Header & ~BinaryRecord;
+		for (uint32_t i = 0; i < Length; i++)
+		{
+			uart->blocking_write(ring.bytes[(tail + 1 + i) % RingBytes]);
+		}
+		if ((Header & BinaryRecord) == 0)
+		{
+			uart->blocking_write('\n');
+		}
+		// Only now can the producer reuse the line's bytes.
+		tail += 1 + Length;
+		__atomic_store_n(&ring.tail, tail, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ring.producerWaiting, __ATOMIC_SEQ_CST) != 0)
+		{
+			futex_wake(&ring.tail, 1);
+		}
+		wrote = true;
+	}
+
+	const uint32_t Dropped = __atomic_load_n(&ring.dropped, __ATOMIC_RELAXED);
+	if (Dropped != ring.droppedReported)
+	{
+		char note[64];
+		sonata::format::format_to(note,
+		                          "async_log: thread {} dropped {} lines\n",
+		                          ring.owner,
+		                          Dropped - ring.droppedReported);
+		sonata::uart_write(uart, note);
+		ring.droppedReported = Dropped;
+		wrote                = true;
+	}
+	return wrote;
+}
+
+void async_log_drain()
+{
+	auto uart = MMIO_CAPABILITY(OpenTitanUart, uart);
+	while (true)
+	{
+		__atomic_store_n(&doorbell, 0, __ATOMIC_SEQ_CST);
+		bool wrote = false;
+		for (LogRing &ring : rings)
+		{
+			if (__atomic_load_n(&ring.owner, __ATOMIC_ACQUIRE) != 0)
+			{
+				wrote |= drain_ring(uart, ring);
+			}
+		}
+		if (wrote)
+		{
+			continue;
+		}
+		// A producer appending after the pass above has set the doorbell,
+		// so either the wait returns at once or the producer sees the flag
+		// and wakes us.
+		__atomic_store_n(&drainWaiting, 1, __ATOMIC_SEQ_CST);
+		Timeout timeout{UnlimitedTimeout};
+		futex_timed_wait(&timeout, &doorbell, 0);
+		__atomic_store_n(&drainWaiting, 0, __ATOMIC_RELAXED);
+	}
+}
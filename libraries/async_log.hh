@@ -0,0 +1,101 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <compartment.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <timeout.h>
+
+#include "format.hh"
+
+/**
+ * The interface of the `async_log` compartment, which takes log lines off
+ * the threads that produce them.  Each thread appends its lines to a ring
+ * of its own, without locks or waiting, and a low-priority thread running
+ * `async_log_drain` writes them out on the UART.  A line that doesn't fit in
+ * its thread's ring is dropped and counted, never waited for, so logging
+ * costs a producer the same whether or not the UART is keeping up.  The
+ * exception is `async_log_write_wait`, for threads that log a burst at once
+ * and would rather wait for the drain than lose lines.
+ *
+ * There are eight rings, each claimed by the first thread to log into it;
+ * once all are claimed, lines from any other thread are dropped.
+ *
+ * Lines from one thread appear in order; lines from different threads may
+ * be interleaved differently from the order in which they were logged.
+ */
+
+/// The longest line kept, in bytes; longer lines are truncated.
+static constexpr size_t AsyncLogMaxLine = 120;
+
+/**
+ * Appends a line of `length` bytes, without its newline, to the calling
+ * thread's ring.  Returns zero on success, `-EINVAL` if the message is not
+ * valid, or `-ENOSPC` if it was dropped because the ring was full or the
+ * thread has no ring.
+ */
+__cheri_compartment("async_log") int async_log_write(const char *message,
+                                                     size_t      length);
+
+/**
+ * As `async_log_write`, but if the ring is full waits up to `timeout` for
+ * the drain to make room, instead of dropping the line at once.  The drain
+ * runs at a low priority, so a thread only gets room by blocking here.
+ * Returns `-ENOSPC` if the line was dropped because the timeout expired.
+ */
+__cheri_compartment("async_log") int async_log_write_wait(Timeout    *timeout,
+                                                          const char *message,
+                                                          size_t      length);
+
+/**
+ * Appends a binary record of `length` bytes, such as one from
+ * `sonata::log` in tokenised mode, to the calling thread's ring.  It is
+ * written out as it is, without a newline, and is never truncated: a record
+ * longer than `AsyncLogMaxLine` is rejected with `-EINVAL`.  Otherwise
+ * returns as `async_log_write`.
+ */
+__cheri_compartment("async_log") int async_log_write_record(
+  const uint8_t *record,
+  size_t         length);
+
+/**
+ * Returns the number of lines and records dropped by the thread with ID
+ * `threadId`, or by all threads if `threadId` is zero.  Those from threads
+ * without a ring are not counted.
+ */
+__cheri_compartment("async_log") uint32_t async_log_dropped(uint16_t threadId);
+
+/**
+ * Thread entry point for the drain, which never returns.  It should run at
+ * a lower priority than the threads that log.
+ */
+[[noreturn]] __cheri_compartment("async_log") void async_log_drain();
+
+namespace sonata
+{
+	/**
+	 * Formats a line with `sonata::format::format_to` and hands it to the
+	 * `async_log` compartment.  Returns as `async_log_write`.
+	 */
+	template<typename... Args>
+	int async_log(const char *format, const Args &...args)
+	{
+		char         line[AsyncLogMaxLine + 1];
+		const size_t Length = format::format_to(line, format, args...);
+		return async_log_write(line, Length);
+	}
+
+	/**
+	 * Formats a line as `async_log` does and hands it to
+	 * `async_log_write_wait`.  Returns as `async_log_write_wait`.
+	 */
+	template<typename... Args>
+	int
+	async_log_wait(Timeout *timeout, const char *format, const Args &...args)
+	{
+		char         line[AsyncLogMaxLine + 1];
+		const size_t Length = format::format_to(line, format, args...);
+		return async_log_write_wait(timeout, line, Length);
+	}
+} // namespace sonata
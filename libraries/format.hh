@@ -0,0 +1,353 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+/**
+ * Building strings for display without `Debug::log`.  `format_to` fills a
+ * caller's buffer from a format string in which each `{}` is replaced by
+ * the next argument, truncating rather than overflowing.  Arguments may be
+ * integers, characters, strings, booleans, or the `Hex` and `Fixed`
+ * wrappers below.
+ *
+ * Ibex has no fast divider, so nothing here divides: decimal digits are
+ * found by multiplying by a reciprocal of ten, or for 64-bit values by
+ * subtracting powers of ten, and fixed-point fractions are scaled by
+ * multiplication and shifts.
+ */
+namespace sonata::format
+{
+	/// An unsigned integer to be written in lowercase hexadecimal.
+	struct Hex
+	{
+		uint64_t value;
+		/// The minimum number of digits, padded with leading zeros.
+		uint8_t  digits = 0;
+	};
+
+	/**
+	 * A signed fixed-point number, `value / 2^fractionBits`, to be written
+	 * rounded to `decimals` decimal places, with halves rounded away from
+	 * zero.  `fractionBits` may be at most 32 and `decimals` at most 9.
+	 */
+	struct Fixed
+	{
+		int64_t value;
+		uint8_t fractionBits;
+		uint8_t decimals;
+	};
+
+	/**
+	 * A bounded view of a character buffer being written, which always
+	 * leaves room for a terminating NUL.  Writes beyond the end are
+	 * dropped, and `truncated` records that this happened.
+	 */
+	class Writer
+	{
+		char  *buffer;
+		size_t capacity;
+		size_t used       = 0;
+		bool   overflowed = false;
+
+		/**
+		 * Helper.  Writes the low `count` decimal digits of `value`, which
+		 * must be less than 10^`count`, with leading zeros.  Each digit is
+		 * the remainder left by multiplying by the reciprocal of ten,
+		 * 0xcccccccd / 2^35, which gives the exact quotient for every
+		 * 32-bit value.
+		 */
+		void put_padded_decimal(uint32_t value, size_t count)
+		{
+			char digits[10];
+			for (size_t i = count; i > 0; i--)
+			{
+				const uint32_t Quotient = static_cast<uint32_t>(
+				  (static_cast<uint64_t>(value) * 0xcccccccdU) >> 35);
+				digits[i - 1] = static_cast<char>(
+				  '0' + (value - ((Quotient << 3) + (Quotient << 1))));
+				value = Quotient;
+			}
+			put(digits, count);
+		}
+
+		public:
+		/// A writer for `capacity` bytes at `buffer`, including the NUL.
+		Writer(char *buffer, size_t capacity)
+		  : buffer(buffer), capacity(capacity)
+		{
+			terminate();
+		}
+
+		/// The number of characters written, not counting the NUL.
+		size_t length() const
+		{
+			return used;
+		}
+
+		/// Returns true if anything was dropped for want of space.
+		bool truncated() const
+		{
+			return overflowed;
+		}
+
+		/// NUL-terminates what has been written so far.
+		void terminate()
+		{
+			if (capacity > 0)
+			{
+				buffer[used] = '\0';
+			}
+		}
+
+		void put(char character)
+		{
+			if (used + 1 >= capacity)
+			{
+				overflowed = true;
+				return;
+			}
+			buffer[used++] = character;
+		}
+
+		void put(const char *characters, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				put(characters[i]);
+			}
+		}
+
+		void put(const char *string)
+		{
+			while (*string != '\0')
+			{
+				put(*string++);
+			}
+		}
+
+		void put(bool value)
+		{
+			put(value ? "true" : "false");
+		}
+
+		void put(uint64_t value)
+		{
+			if (value <= UINT32_MAX)
+			{
+				put(static_cast<uint32_t>(value));
+				return;
+			}
+			// Find the digits above the lowest nine by subtracting 8, 4, 2
+			// and 1 times each power of ten, which leaves a remainder that
+			// the 32-bit path can finish.
+			constexpr uint64_t Powers[] = {
+			  10000000000000000000U,
+			  1000000000000000000U,
+			  100000000000000000U,
+			  10000000000000000U,
+			  1000000000000000U,
+			  100000000000000U,
+			  10000000000000U,
+			  1000000000000U,
+			  100000000000U,
+			  10000000000U,
+			  1000000000U,
+			};
+			bool leading = true;
+			for (uint64_t power : Powers)
+			{
+				uint32_t digit = 0;
+				for (uint32_t weight = 8; weight > 0; weight >>= 1)
+				{
+					// The first power is too big to scale, but no 64-bit
+					// value holds it more than once.
+					if (power > UINT64_MAX / weight)
+					{
+						continue;
+					}
+					if (value >= power * weight)
+					{
+						value -= power * weight;
+						digit += weight;
+					}
+				}
+				leading = leading && digit == 0;
+				if (!leading)
+				{
+					put(static_cast<char>('0' + digit));
+				}
+			}
+			put_padded_decimal(static_cast<uint32_t>(value), 9);
+		}
+
+		void put(uint32_t value)
+		{
+			size_t   count = 1;
+			uint32_t limit = 10;
+			while (count < 10 && value >= limit)
+			{
+				count++;
+				limit = (limit << 3) + (limit << 1);
+			}
+			put_padded_decimal(value, count);
+		}
+
+		void put(int64_t value)
+		{
+			if (value < 0)
+			{
+				put('-');
+				put(uint64_t{0} - static_cast<uint64_t>(value));
+				return;
+			}
+			put(static_cast<uint64_t>(value));
+		}
+
+		void put(Hex hex)
+		{
+			size_t count = 1;
+			while (count < 16 && (hex.value >> (4 * count)) != 0)
+			{
+				count++;
+			}
+			for (size_t i = count; i < hex.digits; i++)
+			{
+				put('0');
+			}
+			for (size_t i = count; i > 0; i--)
+			{
+				put("0123456789abcdef"[(hex.value >> (4 * (i - 1))) & 0xf]);
+			}
+		}
+
+		void put(Fixed fixed)
+		{
+			const uint64_t Magnitude =
+			  fixed.value < 0 ? uint64_t{0} - static_cast<uint64_t>(fixed.value)
+			                  : static_cast<uint64_t>(fixed.value);
+			const uint32_t Bits     = fixed.fractionBits;
+			const uint32_t Decimals = fixed.decimals;
+			uint64_t       integer  = Magnitude >> Bits;
+			const uint64_t Fraction = Magnitude & ((uint64_t{1} << Bits) - 1);
+
+			// Scale the fraction to the decimal places kept, rounding halves
+			// away from zero.  This fits in 64 bits, as the fraction is below
+			// 2^32 and the scale at most 10^9.
+			uint64_t scale = 1;
+			for (uint32_t i = 0; i < Decimals; i++)
+			{
+				scale = (scale << 3) + (scale << 1);
+			}
+			uint64_t decimal = Fraction * scale;
+			if (Bits > 0)
+			{
+				decimal = (decimal + (uint64_t{1} << (Bits - 1))) >> Bits;
+			}
+			if (decimal == scale)
+			{
+				integer++;
+				decimal = 0;
+			}
+
+			if (fixed.value < 0 && (integer != 0 || decimal != 0))
+			{
+				put('-');
+			}
+			put(integer);
+			if (Decimals > 0)
+			{
+				put('.');
+				put_padded_decimal(static_cast<uint32_t>(decimal), Decimals);
+			}
+		}
+
+		/// Any other integer, widened to one of the overloads above.
+		template<typename T>
+		  requires std::is_integral_v<T>
+		void put(T value)
+		{
+			if constexpr (std::is_signed_v<T>)
+			{
+				put(static_cast<int64_t>(value));
+			}
+			else if constexpr (sizeof(T) <= sizeof(uint32_t))
+			{
+				put(static_cast<uint32_t>(value));
+			}
+			else
+			{
+				put(static_cast<uint64_t>(value));
+			}
+		}
+	};
+
+	/**
+	 * Helper.  Copies `format` up to the next `{}` placeholder, returning
+	 * the rest after it, or nullptr if there are no more placeholders.
+	 */
+	inline const char *copy_to_placeholder(Writer &writer, const char *format)
+	{
+		for (; *format != '\0'; format++)
+		{
+			if (format[0] == '{' && format[1] == '}')
+			{
+				return format + 2;
+			}
+			writer.put(*format);
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Writes `format` to `writer`, with each `{}` replaced by the next of
+	 * `args`.  Placeholders beyond the arguments are written as they are,
+	 * and arguments beyond the placeholders are ignored.
+	 */
+	template<typename... Args>
+	void format_to(Writer &writer, const char *format, const Args &...args)
+	{
+		(
+		  [&] {
+			  if (format != nullptr)
+			  {
+				  format = copy_to_placeholder(writer, format);
+				  if (format != nullptr)
+				  {
+					  writer.put(args);
+				  }
+			  }
+		  }(),
+		  ...);
+		if (format != nullptr)
+		{
+			writer.put(format);
+		}
+		writer.terminate();
+	}
+
+	/**
+	 * Formats into `capacity` bytes at `buffer`, always NUL-terminating
+	 * unless `capacity` is zero.  Returns the length of the string written,
+	 * which is cut short if the buffer was too small.
+	 */
+	template<typename... Args>
+	size_t format_to(char       *buffer,
+	                 size_t      capacity,
+	                 const char *format,
+	                 const Args &...args)
+	{
+		Writer writer{buffer, capacity};
+		format_to(writer, format, args...);
+		return writer.length();
+	}
+
+	/// Formats into a character array, as above.
+	template<size_t N, typename... Args>
+	size_t format_to(char (&buffer)[N], const char *format, const Args &...args)
+	{
+		return format_to(buffer, N, format, args...);
+	}
+} // namespace sonata::format
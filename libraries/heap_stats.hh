@@ -0,0 +1,193 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <cheri.hh>
+#include <riscvreg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <timeout.h>
+#include <type_traits>
+#include <vector>
+
+#include "format.hh"
+
+/**
+ * Accounting for the allocations a compartment makes with its default
+ * allocator capability, `MALLOC_CAPABILITY`, so that allocation hot spots
+ * and quota sizes can be chosen from measurements.
+ *
+ * Allocations made through `allocate` and `free`, or through `Allocator`
+ * for standard containers, are counted in the including compartment's
+ * `stats()`: the bytes live and at their peak, the allocations, frees and
+ * failures, and the cycles each allocation took.  Sizes are the lengths of
+ * the capabilities returned, which are rounded up to be representable; the
+ * allocator's own headers are only seen in the quota remaining, which
+ * `report` includes.  Allocations made some other way, such as with `new`
+ * or `token_allocate`, can be counted with `Stats::allocated` and
+ * `Stats::freed`.
+ *
+ *     static sonata::heap::Vector<int> values;
+ *     ...
+ *     char report[160];
+ *     sonata::heap::report(report, sizeof(report));
+ */
+namespace sonata::heap
+{
+	/// Ticks that `allocate` waits for memory by default, as `malloc` does.
+	static constexpr Ticks DefaultTimeout = TICK_RATE_HZ;
+
+	/// The accounting for one compartment's allocations.
+	struct Stats
+	{
+		uint32_t liveBytes           = 0;
+		uint32_t peakBytes           = 0;
+		uint32_t allocations         = 0;
+		uint32_t frees               = 0;
+		/// Allocations that failed, for lack of memory or quota.
+		uint32_t failures            = 0;
+		/// Cycles taken by allocations, in total and at most.
+		uint64_t allocationCycles    = 0;
+		uint32_t maxAllocationCycles = 0;
+
+		/// Counts an allocation of `bytes` that took `cycles`.
+		void allocated(size_t bytes, uint64_t cycles)
+		{
+			liveBytes += bytes;
+			peakBytes = liveBytes > peakBytes ? liveBytes : peakBytes;
+			allocations++;
+			allocationCycles += cycles;
+			if (cycles > maxAllocationCycles)
+			{
+				maxAllocationCycles = static_cast<uint32_t>(cycles);
+			}
+		}
+
+		/// Counts a free of `bytes`.
+		void freed(size_t bytes)
+		{
+			liveBytes -= bytes < liveBytes ? bytes : liveBytes;
+			frees++;
+		}
+	};
+
+	/// Returns the accounting for the calling compartment.
+	inline Stats &stats()
+	{
+		static Stats compartmentStats;
+		return compartmentStats;
+	}
+
+	/**
+	 * Allocates `size` bytes with `MALLOC_CAPABILITY`, waiting up to
+	 * `timeout` for memory, and counts it.  Returns nullptr on failure.
+	 */
+	inline void *allocate(size_t size, Timeout *timeout)
+	{
+		const uint64_t Start   = rdcycle64();
+		void          *pointer =
+		  heap_allocate(timeout, MALLOC_CAPABILITY, size);
+		const uint64_t Cycles  = rdcycle64() - Start;
+
+		CHERI::Capability allocation{static_cast<char *>(pointer)};
+		if (!allocation.is_valid())
+		{
+			stats().failures++;
+			return nullptr;
+		}
+		stats().allocated(allocation.length(), Cycles);
+		return pointer;
+	}
+
+	/// Allocates `size` bytes as above, waiting up to `DefaultTimeout`.
+	inline void *allocate(size_t size)
+	{
+		Timeout timeout{DefaultTimeout};
+		return allocate(size, &timeout);
+	}
+
+	/**
+	 * Allocates an array of `count` zeroed values of type `T`, which must
+	 * be trivial.  Returns nullptr on failure.
+	 */
+	template<typename T>
+	T *allocate_array(size_t count)
+	{
+		static_assert(std::is_trivial_v<T>,
+		              "Only trivial types can be zero-initialised");
+		return static_cast<T *>(allocate(count * sizeof(T)));
+	}
+
+	/// Frees `pointer`, from `allocate`, and counts it.
+	inline int free(void *pointer)
+	{
+		const size_t Length =
+		  CHERI::Capability{static_cast<char *>(pointer)}.length();
+		const int Result = heap_free(MALLOC_CAPABILITY, pointer);
+		if (Result == 0)
+		{
+			stats().freed(Length);
+		}
+		return Result;
+	}
+
+	/// A standard allocator that allocates with `allocate`.
+	template<typename T>
+	struct Allocator
+	{
+		using value_type = T;
+
+		Allocator() = default;
+		template<typename U>
+		Allocator(const Allocator<U> &)
+		{
+		}
+
+		T *allocate(size_t count)
+		{
+			return static_cast<T *>(heap::allocate(count * sizeof(T)));
+		}
+
+		void deallocate(T *pointer, size_t)
+		{
+			heap::free(pointer);
+		}
+
+		template<typename U>
+		bool operator==(const Allocator<U> &) const
+		{
+			return true;
+		}
+	};
+
+	/// A vector whose storage is allocated with `allocate`.
+	template<typename T>
+	using Vector = std::vector<T, Allocator<T>>;
+
+	/**
+	 * Writes a report of the calling compartment's allocations to
+	 * `buffer`, which holds `capacity` bytes, as `key=value` pairs, with
+	 * the quota it has left.  Returns the length written, as
+	 * `format::format_to`.
+	 */
+	inline size_t report(char *buffer, size_t capacity)
+	{
+		const Stats &Counts = stats();
+		return format::format_to(
+		  buffer,
+		  capacity,
+		  "heap: live={} peak={} allocations={} frees={} failures={} "
+		  "mean_cycles={} max_cycles={} quota_remaining={}",
+		  Counts.liveBytes,
+		  Counts.peakBytes,
+		  Counts.allocations,
+		  Counts.frees,
+		  Counts.failures,
+		  Counts.allocations == 0
+		    ? uint64_t{0}
+		    : Counts.allocationCycles / Counts.allocations,
+		  Counts.maxAllocationCycles,
+		  static_cast<int32_t>(heap_quota_remaining(MALLOC_CAPABILITY)));
+	}
+} // namespace sonata::heap
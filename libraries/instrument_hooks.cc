@@ -0,0 +1,99 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include <thread.h>
+
+#ifdef SONATA_PROFILE
+#	include "profiler.hh"
+#endif
+#ifdef SONATA_STACK_USAGE
+#	include "stack_usage.hh"
+#endif
+
+/**
+ * The function instrumentation added by `-finstrument-functions`, linked
+ * into each compartment built with the `profile` or `stack-usage` option.
+ * With `profile`, each keeps the calling thread's shadow stack in
+ * `profiler_state`.  With `stack-usage`, entering a function notes how
+ * deep the calling thread's stack is in `stack_usage_state`.
+ *
+ * The hooks are compiled with the rest of the compartment, so with
+ * `-finstrument-functions`, which instruments inline functions before they
+ * are inlined.  They therefore call only builtins and functions marked
+ * `no_instrument_function`, such as `profiler_state`, because anything
+ * else, such as the methods of `CHERI::Capability`, would call the hooks
+ * again, without end.
+ */
+
+#ifdef SONATA_STACK_USAGE
+/**
+ * Helper.  Notes the depth of the stack of thread `thread`, whose ID has
+ * been checked, if it is the deepest so far.
+ */
+[[gnu::no_instrument_function]] static void note_stack(uint16_t thread)
+{
+	// The stack capability of a compartment call is bounded from the base
+	// of the thread's stack to the caller's stack pointer, so its length
+	// is the whole stack only in the thread's entry compartment.
+	const void      *stack    = __builtin_cheri_stack_get();
+	const uint32_t   Headroom = __builtin_cheri_address_get(stack) -
+	                          __builtin_cheri_base_get(stack);
+	const uint32_t   Length   = __builtin_cheri_length_get(stack);
+	StackUsageState *state    = stack_usage_state();
+	if (state->size[thread - 1] == 0 || Headroom < state->headroom[thread - 1])
+	{
+		state->headroom[thread - 1] = Headroom;
+	}
+	if (Length > state->size[thread - 1])
+	{
+		state->size[thread - 1] = Length;
+	}
+}
+#endif
+
+extern "C" [[gnu::no_instrument_function]] void
+__cyg_profile_func_enter(void *function, void *callSite)
+{
+	const uint16_t Thread = thread_id_get();
+#ifdef SONATA_STACK_USAGE
+	if (Thread != 0 && Thread <= StackUsageMaxThreads)
+	{
+		note_stack(Thread);
+	}
+#endif
+#ifdef SONATA_PROFILE
+	if (Thread == 0 || Thread > ProfilerMaxThreads)
+	{
+		return;
+	}
+	ProfilerState *state = profiler_state();
+	const uint32_t Depth = state->depth[Thread - 1];
+	if (Depth < ProfilerMaxDepth)
+	{
+		state->frames[Thread - 1][Depth] =
+		  __builtin_cheri_address_get(function);
+	}
+	state->depth[Thread - 1] = Depth + 1;
+	state->lastThread        = Thread;
+	state->events++;
+#endif
+}
+
+extern "C" [[gnu::no_instrument_function]] void
+__cyg_profile_func_exit(void *function, void *callSite)
+{
+#ifdef SONATA_PROFILE
+	const uint16_t Thread = thread_id_get();
+	if (Thread == 0 || Thread > ProfilerMaxThreads)
+	{
+		return;
+	}
+	ProfilerState *state = profiler_state();
+	if (state->depth[Thread - 1] > 0)
+	{
+		state->depth[Thread - 1]--;
+	}
+	state->lastThread = Thread;
+	state->events++;
+#endif
+}
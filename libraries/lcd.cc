@@ -2,6 +2,8 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #include "lcd.hh"
+#include "spi_manager.hh"
+#include <riscvreg.h>
 #include <utility>
 
 template<typename T>
@@ -9,14 +11,6 @@ using Cap = CHERI::Capability<T>;
 
 using namespace sonata::lcd;
 
-/**
- * Helper.  Returns a pointer to the SPI device.
- */
-[[nodiscard, gnu::always_inline]] static Cap<volatile SonataSpi> spi()
-{
-	return MMIO_CAPABILITY(SonataSpi, spi1);
-}
-
 /**
  * Helper.  Returns a pointer to the GPIO device.
  */
@@ -30,6 +24,15 @@ static constexpr uint32_t LcdRstPin = 1;
 static constexpr uint32_t LcdDcPin  = 2;
 static constexpr uint32_t LcdBlPin  = 3;
 
+/// How long the LCD is held in reset during initialisation.
+static constexpr uint32_t ResetMilliseconds = 150;
+
+/// How the LCD's SPI bus is driven: mode 0, MSB first, at full speed.
+static constexpr SpiProfile LcdSpiProfile = {.clockPolarity   = false,
+                                             .clockPhase      = false,
+                                             .msbFirst        = true,
+                                             .halfClockPeriod = 0};
+
 static inline void set_gpio_output_bit(uint32_t bit, bool value)
 {
 	uint32_t output = gpio()->output;
@@ -38,34 +41,272 @@ static inline void set_gpio_output_bit(uint32_t bit, bool value)
 	gpio()->output = output;
 }
 
+/**
+ * Helper.  Fills `window` with one RGB565 `pixel` value, streaming it to the
+ * panel from a small buffer so that no per-pixel conversion or write call is
+ * needed.
+ */
+static void fill_window(internal::St7735Context *ctx,
+                        internal::LCD_rectangle  window,
+                        uint16_t                 pixel)
+{
+	static constexpr size_t FillPixels = 32;
+	uint16_t                pixels[FillPixels];
+	std::fill_n(pixels, FillPixels, pixel);
+	size_t remaining = window.width * window.height;
+	internal::lcd_st7735_rgb565_start(ctx, window);
+	while (remaining > 0)
+	{
+		const size_t Count = std::min(remaining, FillPixels);
+		internal::lcd_st7735_rgb565_put(
+		  ctx, reinterpret_cast<const uint8_t *>(pixels), Count * 2);
+		remaining -= Count;
+	}
+	internal::lcd_st7735_rgb565_finish(ctx);
+}
+
+/**
+ * Helper.  Fills the pixels from `x0` to `x1` (inclusive, in either order) on
+ * row `y` with a single window write, after clipping them to `clip`.
+ */
+static void fill_horizontal_span(internal::St7735Context *ctx,
+                                 const Rect              &clip,
+                                 int32_t                  x0,
+                                 int32_t                  x1,
+                                 int32_t                  y,
+                                 uint16_t                 pixel)
+{
+	if (x0 > x1)
+	{
+		std::swap(x0, x1);
+	}
+	x0 = std::max(x0, static_cast<int32_t>(clip.left));
+	x1 = std::min(x1, static_cast<int32_t>(clip.right) - 1);
+	if (y < static_cast<int32_t>(clip.top) ||
+	    y >= static_cast<int32_t>(clip.bottom) || x0 > x1)
+	{
+		return;
+	}
+	fill_window(ctx,
+	            {{static_cast<uint32_t>(x0), static_cast<uint32_t>(y)},
+	             static_cast<uint32_t>(x1 - x0 + 1),
+	             1},
+	            pixel);
+}
+
+/**
+ * Helper.  Fills the pixels from `y0` to `y1` (inclusive, in either order) in
+ * column `x` with a single window write, after clipping them to `clip`.
+ */
+static void fill_vertical_span(internal::St7735Context *ctx,
+                               const Rect              &clip,
+                               int32_t                  x,
+                               int32_t                  y0,
+                               int32_t                  y1,
+                               uint16_t                 pixel)
+{
+	if (y0 > y1)
+	{
+		std::swap(y0, y1);
+	}
+	y0 = std::max(y0, static_cast<int32_t>(clip.top));
+	y1 = std::min(y1, static_cast<int32_t>(clip.bottom) - 1);
+	if (x < static_cast<int32_t>(clip.left) ||
+	    x >= static_cast<int32_t>(clip.right) || y0 > y1)
+	{
+		return;
+	}
+	fill_window(ctx,
+	            {{static_cast<uint32_t>(x), static_cast<uint32_t>(y0)},
+	             1,
+	             static_cast<uint32_t>(y1 - y0 + 1)},
+	            pixel);
+}
+
+/**
+ * Helper.  Returns the first of `scaled` destination pixels whose
+ * nearest-neighbour sample, out of `source` pixels, is at or after `index`.
+ * Destination pixel `d` samples source pixel `((2d + 1) * source) /
+ * (2 * scaled)`, i.e. the one under its centre.
+ */
+static uint32_t first_scaled_pixel(uint32_t index,
+                                   uint32_t source,
+                                   uint32_t scaled)
+{
+	uint32_t numerator = 2 * index * scaled;
+	if (numerator <= source)
+	{
+		return 0;
+	}
+	return (numerator + source - 1) / (2 * source);
+}
+
+/**
+ * Helper.  Draws the part of an image at `rect`, relative to `viewport`, that
+ * lies inside the viewport.  Unclipped images are passed to `draw` whole;
+ * clipped images are passed one visible row at a time.
+ */
+static void draw_clipped_image(Rect           viewport,
+                               Rect           rect,
+                               const uint8_t *data,
+                               size_t         bytesPerPixel,
+                               auto         &&draw)
+{
+	Rect image   = rect.translated({viewport.left, viewport.top});
+	Rect visible = image.intersection(viewport);
+	if (visible.is_empty())
+	{
+		return;
+	}
+	const uint32_t Width        = visible.right - visible.left;
+	const size_t   RowStride    = (image.right - image.left) * bytesPerPixel;
+	const size_t   ColumnOffset = (visible.left - image.left) * bytesPerPixel;
+	if (visible.left == image.left && visible.right == image.right)
+	{
+		// Whole rows are visible, so the rows can be drawn in one window.
+		draw(internal::LCD_rectangle{{visible.left, visible.top},
+		                             Width,
+		                             visible.bottom - visible.top},
+		     data + (visible.top - image.top) * RowStride);
+		return;
+	}
+	for (uint32_t y = visible.top; y < visible.bottom; y++)
+	{
+		draw(internal::LCD_rectangle{{visible.left, y}, Width, 1},
+		     data + (y - image.top) * RowStride + ColumnOffset);
+	}
+}
+
+/**
+ * Helper.  Converts `count` pixels of blue, green, red bytes to RGB565.  When
+ * `bgr` is word aligned, each group of four pixels is converted from three
+ * word loads with shifts and masks, rather than byte by byte.
+ */
+static void bgr888_to_rgb565(const uint8_t *bgr, uint16_t *rgb565, size_t count)
+{
+	size_t i = 0;
+	if ((Cap<const uint8_t>{bgr}.address() & 3) == 0)
+	{
+		const auto *words = reinterpret_cast<const uint32_t *>(bgr);
+		for (; i + 4 <= count; i += 4, words += 3)
+		{
+			// Little-endian words hold B0 G0 R0 B1, G1 R1 B2 G2, R2 B3 G3 R3.
+			const uint32_t W0 = words[0];
+			const uint32_t W1 = words[1];
+			const uint32_t W2 = words[2];
+			rgb565[i] = ((W0 >> 8) & 0xF800) | ((W0 >> 5) & 0x07E0) |
+			            ((W0 >> 3) & 0x001F);
+			rgb565[i + 1] = (W1 & 0xF800) | ((W1 << 3) & 0x07E0) | (W0 >> 27);
+			rgb565[i + 2] = ((W2 << 8) & 0xF800) | ((W1 >> 21) & 0x07E0) |
+			                ((W1 >> 19) & 0x001F);
+			rgb565[i + 3] = ((W2 >> 16) & 0xF800) | ((W2 >> 13) & 0x07E0) |
+			                ((W2 >> 11) & 0x001F);
+		}
+	}
+	for (; i < count; i++)
+	{
+		const uint8_t *pixel = bgr + i * 3;
+		rgb565[i] = Color::from_rgb(pixel[2], pixel[1], pixel[0]).to_rgb565();
+	}
+}
+
+/**
+ * Helper.  Returns the font used for all text.
+ */
+static const internal::Font *text_font()
+{
+	return &internal::m3x6_16ptFont;
+}
+
+/**
+ * Helper.  Selects the text font and colours for the following glyphs.  The
+ * driver renders text from 24-bit colours, so they are converted here, once
+ * per call.
+ */
+static void use_text_colors(internal::St7735Context *ctx,
+                            Color                    background,
+                            Color                    foreground)
+{
+	internal::lcd_st7735_set_font(ctx, text_font());
+	internal::lcd_st7735_set_font_colors(
+	  ctx, background.to_bgr888(), foreground.to_bgr888());
+}
+
+uint32_t __cheri_libcall sonata::lcd::glyph_width(char character)
+{
+	const internal::Font *font = text_font();
+	if (character < font->startCharacter || character > font->endCharacter)
+	{
+		return 0;
+	}
+	return font->descriptor_table[character - font->startCharacter].width;
+}
+
+uint32_t __cheri_libcall sonata::lcd::font_height()
+{
+	return text_font()->height;
+}
+
 namespace sonata::lcd::internal
 {
 	void __cheri_libcall lcd_init(LCD_Interface *lcdIntf, St7735Context *ctx)
+	{
+		lcd_init_finish(lcdIntf, ctx, lcd_init_start(lcdIntf));
+	}
+
+	uint64_t __cheri_libcall lcd_init_start(LCD_Interface *lcdIntf)
 	{
 		// Set the initial state of the LCD control pins.
 		set_gpio_output_bit(LcdDcPin, false);
 		set_gpio_output_bit(LcdBlPin, true);
 		set_gpio_output_bit(LcdCsPin, false);
 
-		// Initialise SPI driver.
-		spi()->init(false, false, true, false);
+		// Register with the SPI manager, which configures the controller
+		// whenever the bus is acquired for the LCD.
+		lcdIntf->handle = spi_device_open(SpiBus::Spi1, LcdSpiProfile);
 
-		// Reset LCD.
+		// Start resetting the LCD.
 		set_gpio_output_bit(LcdRstPin, false);
-		thread_millisecond_wait(150);
+		return rdcycle64();
+	}
+
+	void __cheri_libcall lcd_init_finish(LCD_Interface *lcdIntf,
+	                                     St7735Context *ctx,
+	                                     uint64_t       resetStart)
+	{
+		// Only wait for the part of the reset period that hasn't already
+		// passed.
+		const uint64_t CyclesPerMillisecond = CPU_TIMER_HZ / 1000;
+		const uint64_t Elapsed =
+		  (rdcycle64() - resetStart) / CyclesPerMillisecond;
+		if (Elapsed < ResetMilliseconds)
+		{
+			thread_millisecond_wait(ResetMilliseconds - Elapsed);
+		}
 		set_gpio_output_bit(LcdRstPin, true);
 
-		// Initialise LCD driverr.
-		lcdIntf->handle = nullptr;
+		// Initialise LCD driverr.  The bus is held for as long as the
+		// driver asserts chip select; acquiring it again while it is held
+		// does nothing.
 		lcdIntf->spi_write =
 		  [](void *handle, uint8_t *data, size_t len) -> uint32_t {
-			spi()->blocking_write(data, len);
+			spi_write(static_cast<SpiDevice *>(handle), data, len);
 			return len;
 		};
 		lcdIntf->gpio_write =
 		  [](void *handle, bool csHigh, bool dcHigh) -> uint32_t {
+			auto *device = static_cast<SpiDevice *>(handle);
+			if (!csHigh)
+			{
+				Timeout timeout{UnlimitedTimeout};
+				spi_acquire(device, &timeout);
+			}
 			set_gpio_output_bit(LcdCsPin, csHigh);
 			set_gpio_output_bit(LcdDcPin, dcHigh);
+			if (csHigh)
+			{
+				spi_release(device);
+			}
 			return 0;
 		};
 		lcdIntf->timer_delay = [](uint32_t ms) { thread_millisecond_wait(ms); };
@@ -76,6 +317,7 @@ namespace sonata::lcd::internal
 
 		lcd_st7735_clean(ctx);
 	}
+
 	void __cheri_libcall lcd_destroy(LCD_Interface *lcdIntf, St7735Context *ctx)
 	{
 		lcd_st7735_clean(ctx);
@@ -83,33 +325,84 @@ namespace sonata::lcd::internal
 		set_gpio_output_bit(LcdRstPin, false);
 		// Turn off backlight.
 		set_gpio_output_bit(LcdBlPin, false);
+		spi_device_close(static_cast<SpiDevice *>(lcdIntf->handle));
 	}
 } // namespace sonata::lcd::internal
 
+void __cheri_libcall SonataLcd::set_viewport(Rect rect)
+{
+	viewport = rect.intersection(
+	  Rect::from_point_and_size(Point::ORIGIN, resolution()));
+}
+
 void __cheri_libcall SonataLcd::clean()
 {
-	// Clean the display with a white rectangle.
-	lcd_st7735_clean(&ctx);
+	// Clean the viewport with a white rectangle.
+	clean(Color::White);
 }
 
 void __cheri_libcall SonataLcd::clean(Color color)
 {
-	// Clean the display with a rectangle of the given colour
-	size_t w, h;
-	lcd_st7735_get_resolution(&ctx, &h, &w);
-	lcd_st7735_fill_rectangle(
-	  &ctx,
-	  {.origin = {.x = 0, .y = 0}, .width = w, .height = h},
-	  static_cast<uint32_t>(color));
+	// Clean the viewport with a rectangle of the given colour
+	fill_window(&ctx,
+	            {{viewport.left, viewport.top},
+	             viewport.right - viewport.left,
+	             viewport.bottom - viewport.top},
+	            color.to_rgb565());
 }
 
 void __cheri_libcall SonataLcd::draw_image_rgb565(Rect           rect,
                                                   const uint8_t *data)
 {
-	internal::lcd_st7735_draw_rgb565(
-	  &ctx,
-	  {{rect.left, rect.top}, rect.right - rect.left, rect.bottom - rect.top},
-	  data);
+	draw_clipped_image(
+	  viewport, rect, data, 2, [&](auto window, const uint8_t *pixels) {
+		  internal::lcd_st7735_draw_rgb565(&ctx, window, pixels);
+	  });
+}
+
+void __cheri_libcall SonataLcd::draw_image_rgb565(Rect        rect,
+                                                  ImageReader read,
+                                                  void       *context)
+{
+	Rect image   = rect.translated({viewport.left, viewport.top});
+	Rect visible = image.intersection(viewport);
+	if (visible.is_empty())
+	{
+		return;
+	}
+	uint8_t    chunk[ImageChunkSize];
+	const auto Stream =
+	  [&](internal::LCD_rectangle window, size_t offset, size_t length) {
+		  internal::lcd_st7735_rgb565_start(&ctx, window);
+		  while (length > 0)
+		  {
+			  const size_t Count = std::min(length, ImageChunkSize);
+			  read(context, offset, chunk, Count);
+			  internal::lcd_st7735_rgb565_put(&ctx, chunk, Count);
+			  offset += Count;
+			  length -= Count;
+		  }
+		  internal::lcd_st7735_rgb565_finish(&ctx);
+	  };
+
+	const uint32_t Width        = visible.right - visible.left;
+	const size_t   RowStride    = (image.right - image.left) * 2;
+	const size_t   ColumnOffset = (visible.left - image.left) * 2;
+	if (visible.left == image.left && visible.right == image.right)
+	{
+		// Whole rows are visible, so the image is one contiguous stream.
+		const uint32_t Height = visible.bottom - visible.top;
+		Stream({{visible.left, visible.top}, Width, Height},
+		       (visible.top - image.top) * RowStride,
+		       Height * RowStride);
+		return;
+	}
+	for (uint32_t y = visible.top; y < visible.bottom; y++)
+	{
+		Stream({{visible.left, y}, Width, 1},
+		       (y - image.top) * RowStride + ColumnOffset,
+		       Width * 2);
+	}
 }
 
 void __cheri_libcall SonataLcd::draw_str(Point       point,
@@ -117,54 +410,557 @@ void __cheri_libcall SonataLcd::draw_str(Point       point,
                                          Color       background,
                                          Color       foreground)
 {
-	lcd_st7735_set_font(&ctx, &internal::m3x6_16ptFont);
-	lcd_st7735_set_font_colors(&ctx,
-	                           static_cast<uint32_t>(background),
-	                           static_cast<uint32_t>(foreground));
-	lcd_st7735_puts(&ctx, {point.x, point.y}, str);
+	use_text_colors(&ctx, background, foreground);
+
+	uint32_t x = point.x + viewport.left;
+	uint32_t y = point.y + viewport.top;
+	if (y + font_height() > viewport.bottom)
+	{
+		return;
+	}
+	uint32_t width = 0;
+	for (const char *c = str; *c != '\0'; c++)
+	{
+		width += glyph_width(*c);
+	}
+	if (x + width <= viewport.right)
+	{
+		lcd_st7735_puts(&ctx, {x, y}, str);
+		return;
+	}
+	// Draw as many whole glyphs as fit in the viewport.
+	for (const char *c = str; *c != '\0'; c++)
+	{
+		width = glyph_width(*c);
+		if (x + width > viewport.right)
+		{
+			break;
+		}
+		lcd_st7735_putchar(&ctx, {x, y}, *c);
+		x += width;
+	}
+}
+
+void __cheri_libcall SonataLcd::draw_char(Point point,
+                                          char  character,
+                                          Color background,
+                                          Color foreground)
+{
+	uint32_t x = point.x + viewport.left;
+	uint32_t y = point.y + viewport.top;
+	if (x + glyph_width(character) > viewport.right ||
+	    y + font_height() > viewport.bottom)
+	{
+		return;
+	}
+	use_text_colors(&ctx, background, foreground);
+	lcd_st7735_putchar(&ctx, {x, y}, character);
 }
 
 void __cheri_libcall SonataLcd::draw_pixel(Point point, Color color)
 {
-	lcd_st7735_draw_pixel(
-	  &ctx, {point.x, point.y}, static_cast<uint32_t>(color));
+	uint32_t x = point.x + viewport.left;
+	uint32_t y = point.y + viewport.top;
+	if (x >= viewport.right || y >= viewport.bottom)
+	{
+		return;
+	}
+	fill_window(&ctx, {{x, y}, 1, 1}, color.to_rgb565());
 }
 
 void __cheri_libcall SonataLcd::draw_line(Point a, Point b, Color color)
 {
-	if (a.y == b.y)
+	const auto Pixel = color.to_rgb565();
+	int32_t    x0    = a.x + viewport.left;
+	int32_t    y0    = a.y + viewport.top;
+	int32_t    x1    = b.x + viewport.left;
+	int32_t    y1    = b.y + viewport.top;
+	int32_t    dx    = x1 > x0 ? x1 - x0 : x0 - x1;
+	int32_t    dy    = y1 > y0 ? y1 - y0 : y0 - y1;
+	int32_t    sx    = x1 > x0 ? 1 : -1;
+	int32_t    sy    = y1 > y0 ? 1 : -1;
+
+	if (dx >= dy)
 	{
-		uint32_t x1 = std::min(a.x, b.x);
-		uint32_t x2 = std::max(a.x, b.x);
-		lcd_st7735_draw_horizontal_line(
-		  &ctx, {{x1, a.y}, x2 - x1}, static_cast<uint32_t>(color));
+		// X-major: every step moves along x, so the line is a sequence of
+		// horizontal runs that each end when the error term steps y.
+		int32_t err      = 2 * dy - dx;
+		int32_t runStart = x0;
+		int32_t y        = y0;
+		for (int32_t x = x0; x != x1; x += sx)
+		{
+			if (err > 0)
+			{
+				fill_horizontal_span(&ctx, viewport, runStart, x, y, Pixel);
+				runStart = x + sx;
+				y += sy;
+				err -= 2 * dx;
+			}
+			err += 2 * dy;
+		}
+		fill_horizontal_span(&ctx, viewport, runStart, x1, y, Pixel);
 	}
-	else if (a.x == b.x)
+	else
 	{
-		uint32_t y1 = std::min(a.y, b.y);
-		uint32_t y2 = std::max(a.y, b.y);
-		lcd_st7735_draw_vertical_line(
-		  &ctx, {{a.x, y1}, y2 - y1}, static_cast<uint32_t>(color));
+		// Y-major: the same, with the axes swapped.
+		int32_t err      = 2 * dx - dy;
+		int32_t runStart = y0;
+		int32_t x        = x0;
+		for (int32_t y = y0; y != y1; y += sy)
+		{
+			if (err > 0)
+			{
+				fill_vertical_span(&ctx, viewport, x, runStart, y, Pixel);
+				runStart = y + sy;
+				x += sx;
+				err -= 2 * dy;
+			}
+			err += 2 * dx;
+		}
+		fill_vertical_span(&ctx, viewport, x, runStart, y1, Pixel);
 	}
-	else
+}
+
+void __cheri_libcall SonataLcd::draw_polyline(const Point *points,
+                                              size_t       count,
+                                              Color        color)
+{
+	for (size_t i = 1; i < count; i++)
+	{
+		draw_line(points[i - 1], points[i], color);
+	}
+}
+
+void __cheri_libcall SonataLcd::draw_rect(Rect rect, Color color)
+{
+	if (rect.right <= rect.left || rect.bottom <= rect.top)
+	{
+		return;
+	}
+	const auto Pixel  = color.to_rgb565();
+	int32_t    left   = rect.left + viewport.left;
+	int32_t    top    = rect.top + viewport.top;
+	int32_t    right  = rect.right + viewport.left - 1;
+	int32_t    bottom = rect.bottom + viewport.top - 1;
+	fill_horizontal_span(&ctx, viewport, left, right, top, Pixel);
+	if (bottom == top)
+	{
+		return;
+	}
+	fill_horizontal_span(&ctx, viewport, left, right, bottom, Pixel);
+	if (bottom - top > 1)
+	{
+		fill_vertical_span(&ctx, viewport, left, top + 1, bottom - 1, Pixel);
+		fill_vertical_span(&ctx, viewport, right, top + 1, bottom - 1, Pixel);
+	}
+}
+
+void __cheri_libcall SonataLcd::draw_circle(Point    center,
+                                            uint32_t radius,
+                                            Color    color)
+{
+	const auto Pixel = color.to_rgb565();
+	int32_t    cx    = center.x + viewport.left;
+	int32_t    cy    = center.y + viewport.top;
+
+	// Walk the octant from (radius, 0) towards the diagonal.  Consecutive
+	// points that share an x coordinate form a vertical run, which is
+	// mirrored into four vertical spans and, by swapping the axes, into four
+	// horizontal spans.
+	int32_t x        = radius;
+	int32_t y        = 0;
+	int32_t err      = 1 - x;
+	int32_t runStart = 0;
+	while (x >= y)
+	{
+		int32_t runX   = x;
+		int32_t runEnd = y;
+		y++;
+		if (err < 0)
+		{
+			err += 2 * y + 1;
+		}
+		else
+		{
+			x--;
+			err += 2 * (y - x) + 1;
+		}
+		if (x == runX && x >= y)
+		{
+			continue;
+		}
+
+		if (runStart == 0)
+		{
+			// Runs touching an axis are mirrored onto themselves, so draw
+			// them as single spans.
+			fill_vertical_span(
+			  &ctx, viewport, cx + runX, cy - runEnd, cy + runEnd, Pixel);
+			fill_vertical_span(
+			  &ctx, viewport, cx - runX, cy - runEnd, cy + runEnd, Pixel);
+			fill_horizontal_span(
+			  &ctx, viewport, cx - runEnd, cx + runEnd, cy + runX, Pixel);
+			fill_horizontal_span(
+			  &ctx, viewport, cx - runEnd, cx + runEnd, cy - runX, Pixel);
+		}
+		else
+		{
+			fill_vertical_span(
+			  &ctx, viewport, cx + runX, cy + runStart, cy + runEnd, Pixel);
+			fill_vertical_span(
+			  &ctx, viewport, cx + runX, cy - runEnd, cy - runStart, Pixel);
+			fill_vertical_span(
+			  &ctx, viewport, cx - runX, cy + runStart, cy + runEnd, Pixel);
+			fill_vertical_span(
+			  &ctx, viewport, cx - runX, cy - runEnd, cy - runStart, Pixel);
+			fill_horizontal_span(
+			  &ctx, viewport, cx + runStart, cx + runEnd, cy + runX, Pixel);
+			fill_horizontal_span(
+			  &ctx, viewport, cx - runEnd, cx - runStart, cy + runX, Pixel);
+			fill_horizontal_span(
+			  &ctx, viewport, cx + runStart, cx + runEnd, cy - runX, Pixel);
+			fill_horizontal_span(
+			  &ctx, viewport, cx - runEnd, cx - runStart, cy - runX, Pixel);
+		}
+		runStart = y;
+	}
+}
+
+void __cheri_libcall SonataLcd::fill_circle(Point    center,
+                                            uint32_t radius,
+                                            Color    color)
+{
+	const auto Pixel = color.to_rgb565();
+	int32_t    cx    = center.x + viewport.left;
+	int32_t    cy    = center.y + viewport.top;
+
+	// The same octant walk as `draw_circle`, emitting one horizontal span per
+	// row.  Rows near the centre are visited once per step of y, rows near
+	// the top and bottom only once x has finished its run.
+	int32_t x   = radius;
+	int32_t y   = 0;
+	int32_t err = 1 - x;
+	while (x >= y)
+	{
+		int32_t rowX = x;
+		int32_t rowY = y;
+		fill_horizontal_span(
+		  &ctx, viewport, cx - rowX, cx + rowX, cy + rowY, Pixel);
+		if (rowY != 0)
+		{
+			fill_horizontal_span(
+			  &ctx, viewport, cx - rowX, cx + rowX, cy - rowY, Pixel);
+		}
+		y++;
+		if (err < 0)
+		{
+			err += 2 * y + 1;
+		}
+		else
+		{
+			x--;
+			err += 2 * (y - x) + 1;
+			if (rowX > rowY)
+			{
+				fill_horizontal_span(
+				  &ctx, viewport, cx - rowY, cx + rowY, cy + rowX, Pixel);
+				fill_horizontal_span(
+				  &ctx, viewport, cx - rowY, cx + rowY, cy - rowX, Pixel);
+			}
+		}
+	}
+}
+
+void __cheri_libcall SonataLcd::fill_polygon(const Point *points,
+                                             size_t       count,
+                                             Color        color)
+{
+	// Edges are held on the stack, so the vertex count is bounded.
+	if (count < 3 || count > MaxPolygonVertices)
+	{
+		return;
+	}
+	const auto Pixel = color.to_rgb565();
+
+	// Build the edge table.  Each edge covers the scanlines in
+	// [yTop, yBottom), so shared vertices are only counted once, and tracks
+	// its x intercept as an integer plus a fraction of `dy`.  Stepping the
+	// intercept is then exact and needs only one division per edge.
+	struct Edge
+	{
+		int32_t yTop;
+		int32_t yBottom;
+		int32_t dy;
+		int32_t x;
+		int32_t fraction;
+		int32_t step;
+		int32_t stepFraction;
+	} edges[MaxPolygonVertices];
+	size_t  edgeCount = 0;
+	int32_t minY      = INT32_MAX;
+	int32_t maxY      = INT32_MIN;
+	for (size_t i = 0; i < count; i++)
+	{
+		Point a = {points[i].x + viewport.left, points[i].y + viewport.top};
+		Point b = {points[(i + 1) % count].x + viewport.left,
+		           points[(i + 1) % count].y + viewport.top};
+		if (a.y == b.y)
+		{
+			continue;
+		}
+		if (a.y > b.y)
+		{
+			std::swap(a, b);
+		}
+		int32_t dx           = static_cast<int32_t>(b.x) - a.x;
+		int32_t dy           = static_cast<int32_t>(b.y) - a.y;
+		int32_t step         = dx / dy;
+		int32_t stepFraction = dx % dy;
+		if (stepFraction < 0)
+		{
+			step--;
+			stepFraction += dy;
+		}
+		edges[edgeCount++] = {static_cast<int32_t>(a.y),
+		                      static_cast<int32_t>(b.y),
+		                      dy,
+		                      static_cast<int32_t>(a.x),
+		                      0,
+		                      step,
+		                      stepFraction};
+		minY               = std::min(minY, static_cast<int32_t>(a.y));
+		maxY               = std::max(maxY, static_cast<int32_t>(b.y));
+	}
+	maxY = std::min(maxY, static_cast<int32_t>(viewport.bottom));
+
+	int32_t crossings[MaxPolygonVertices];
+	for (int32_t y = minY; y < maxY; y++)
+	{
+		// Collect the edges crossing this row, sorted by the first pixel at
+		// or to the right of the intercept, and step them to the next row.
+		size_t crossingCount = 0;
+		for (size_t i = 0; i < edgeCount; i++)
+		{
+			Edge &current = edges[i];
+			if (y < current.yTop || y >= current.yBottom)
+			{
+				continue;
+			}
+			int32_t x = current.x + (current.fraction > 0 ? 1 : 0);
+			size_t  j = crossingCount++;
+			for (; j > 0 && crossings[j - 1] > x; j--)
+			{
+				crossings[j] = crossings[j - 1];
+			}
+			crossings[j] = x;
+
+			current.x += current.step;
+			current.fraction += current.stepFraction;
+			if (current.fraction >= current.dy)
+			{
+				current.x++;
+				current.fraction -= current.dy;
+			}
+		}
+		// Fill the pixels lying in [start, end) of each pair of intercepts.
+		for (size_t i = 0; i + 1 < crossingCount; i += 2)
+		{
+			if (crossings[i] < crossings[i + 1])
+			{
+				fill_horizontal_span(
+				  &ctx, viewport, crossings[i], crossings[i + 1] - 1, y, Pixel);
+			}
+		}
+	}
+}
+
+size_t __cheri_libcall Sprite::opaque_spans(Color       key,
+                                            SpriteSpan *spans,
+                                            size_t      maxSpans) const
+{
+	const uint16_t  Key    = key.to_rgb565();
+	const auto     *pixels = reinterpret_cast<const uint16_t *>(data);
+	size_t          count  = 0;
+	for (uint32_t row = 0; row < size.height; row++)
 	{
-		// We currently only support horizontal and vertical lines.
-		panic();
+		const uint16_t *line  = pixels + row * size.width;
+		uint32_t        start = 0;
+		while (start < size.width)
+		{
+			if (line[start] == Key)
+			{
+				start++;
+				continue;
+			}
+			uint32_t end = start + 1;
+			while (end < size.width && line[end] != Key)
+			{
+				end++;
+			}
+			if (count < maxSpans)
+			{
+				spans[count] = {static_cast<uint8_t>(row),
+				                static_cast<uint8_t>(start),
+				                static_cast<uint8_t>(end - start)};
+			}
+			count++;
+			start = end;
+		}
+	}
+	return count;
+}
+
+void __cheri_libcall SonataLcd::draw_sprite(Point             point,
+                                            Sprite            sprite,
+                                            const SpriteSpan *spans,
+                                            size_t            spanCount,
+                                            uint32_t          scale)
+{
+	Size scaled = {sprite.size.width * scale, sprite.size.height * scale};
+	draw_sprite_scaled(
+	  Rect::from_point_and_size(point, scaled), sprite, spans, spanCount);
+}
+
+void __cheri_libcall SonataLcd::draw_sprite_scaled(Rect              rect,
+                                                   Sprite            sprite,
+                                                   const SpriteSpan *spans,
+                                                   size_t spanCount)
+{
+	rect = rect.translated({viewport.left, viewport.top});
+	const uint32_t SourceWidth  = sprite.size.width;
+	const uint32_t SourceHeight = sprite.size.height;
+	const uint32_t Width        = rect.right - rect.left;
+	const uint32_t Height       = rect.bottom - rect.top;
+	if (SourceWidth == 0 || SourceHeight == 0 || Width == 0 || Height == 0)
+	{
+		return;
+	}
+	const auto *pixels   = reinterpret_cast<const uint16_t *>(sprite.data);
+	const bool  Unscaled = Width == SourceWidth && Height == SourceHeight;
+	// Only the part of the destination inside the viewport is drawn.
+	const Rect Visible = rect.intersection(viewport);
+
+	// Pixels for scaled spans are staged in a single row, which is written
+	// once for each destination row that samples the same sprite row.
+	static constexpr uint32_t StagingPixels = 160;
+	uint16_t                  staged[StagingPixels];
+
+	auto drawSpan = [&](uint32_t row, uint32_t start, uint32_t length) {
+		uint32_t top = std::max(
+		  rect.top + first_scaled_pixel(row, SourceHeight, Height),
+		  Visible.top);
+		uint32_t bottom = std::min(
+		  rect.top + first_scaled_pixel(row + 1, SourceHeight, Height),
+		  Visible.bottom);
+		uint32_t left = std::max(
+		  rect.left + first_scaled_pixel(start, SourceWidth, Width),
+		  Visible.left);
+		uint32_t right = std::min(
+		  rect.left + first_scaled_pixel(start + length, SourceWidth, Width),
+		  Visible.right);
+		if (top >= bottom || left >= right)
+		{
+			return;
+		}
+		const uint16_t *source = pixels + row * SourceWidth;
+		if (Unscaled)
+		{
+			// The sprite row can be written straight from the image data.
+			internal::lcd_st7735_draw_rgb565(
+			  &ctx,
+			  {{left, top}, right - left, 1},
+			  reinterpret_cast<const uint8_t *>(source + (left - rect.left)));
+			return;
+		}
+		while (left < right)
+		{
+			// Step the centre of each destination pixel through the source
+			// row as a quotient and remainder of `2 * Width`, so that no
+			// division is needed per pixel.
+			const uint32_t SampleStep    = SourceWidth / Width;
+			const uint32_t RemainderStep = (2 * SourceWidth) % (2 * Width);
+
+			uint32_t segment   = std::min(right - left, StagingPixels);
+			uint32_t numerator = (2 * (left - rect.left) + 1) * SourceWidth;
+			uint32_t sample    = numerator / (2 * Width);
+			uint32_t remainder = numerator % (2 * Width);
+			for (uint32_t i = 0; i < segment; i++)
+			{
+				staged[i] = source[sample];
+				sample += SampleStep;
+				remainder += RemainderStep;
+				if (remainder >= 2 * Width)
+				{
+					remainder -= 2 * Width;
+					sample++;
+				}
+			}
+			internal::lcd_st7735_rgb565_start(
+			  &ctx, {{left, top}, segment, bottom - top});
+			for (uint32_t y = top; y < bottom; y++)
+			{
+				internal::lcd_st7735_rgb565_put(
+				  &ctx,
+				  reinterpret_cast<const uint8_t *>(staged),
+				  segment * sizeof(uint16_t));
+			}
+			internal::lcd_st7735_rgb565_finish(&ctx);
+			left += segment;
+		}
+	};
+
+	if (spans == nullptr)
+	{
+		for (uint32_t row = 0; row < SourceHeight; row++)
+		{
+			drawSpan(row, 0, SourceWidth);
+		}
+		return;
+	}
+	for (size_t i = 0; i < spanCount; i++)
+	{
+		drawSpan(spans[i].row, spans[i].start, spans[i].length);
 	}
 }
 
 void __cheri_libcall SonataLcd::draw_image_bgr(Rect rect, const uint8_t *data)
 {
-	lcd_st7735_draw_bgr(
-	  &ctx,
-	  {{rect.left, rect.top}, rect.right - rect.left, rect.bottom - rect.top},
-	  data);
+	draw_clipped_image(
+	  viewport, rect, data, 3, [&](auto window, const uint8_t *pixels) {
+		  static constexpr size_t StagingPixels = 64;
+		  uint16_t                staged[StagingPixels];
+		  size_t remaining = window.width * window.height;
+		  internal::lcd_st7735_rgb565_start(&ctx, window);
+		  while (remaining > 0)
+		  {
+			  const size_t Count = std::min(remaining, StagingPixels);
+			  bgr888_to_rgb565(pixels, staged, Count);
+			  internal::lcd_st7735_rgb565_put(
+			    &ctx, reinterpret_cast<const uint8_t *>(staged), Count * 2);
+			  pixels += Count * 3;
+			  remaining -= Count;
+		  }
+		  internal::lcd_st7735_rgb565_finish(&ctx);
+	  });
 }
 
 void __cheri_libcall SonataLcd::fill_rect(Rect rect, Color color)
 {
-	lcd_st7735_fill_rectangle(
+	rect =
+	  rect.translated({viewport.left, viewport.top}).intersection(viewport);
+	if (rect.is_empty())
+	{
+		return;
+	}
+	fill_window(
 	  &ctx,
 	  {{rect.left, rect.top}, rect.right - rect.left, rect.bottom - rect.top},
-	  static_cast<uint32_t>(color));
+	  color.to_rgb565());
+}
+
+void __cheri_libcall SonataLcd::abandon_transfer()
+{
+	set_gpio_output_bit(LcdCsPin, true);
+	// Fails harmlessly if the calling thread doesn't hold the bus.
+	spi_release(static_cast<SpiDevice *>(lcdIntf.handle));
 }
@@ -1,8 +1,10 @@
 // Copyright lowRISC Contributors.
 // SPDX-License-Identifier: Apache-2.0
 
+#pragma once
 #include <algorithm>
 #include <cheri.hh>
+#include <cstring>
 #include <platform-gpio.hh>
 #include <platform-spi.hh>
 #include <thread.h>
@@ -18,6 +20,20 @@ namespace sonata::lcd
 #include "../third_party/display_drivers/st7735/lcd_st7735.h"
 		}
 		void __cheri_libcall lcd_init(LCD_Interface *, St7735Context *);
+		/**
+		 * The first half of `lcd_init`: opens the LCD's SPI device, puts
+		 * the LCD into reset and returns the cycle count at which it did
+		 * so, without waiting.
+		 */
+		uint64_t __cheri_libcall lcd_init_start(LCD_Interface *);
+		/**
+		 * The second half of `lcd_init`: waits for whatever remains of the
+		 * reset period that began at `resetStart`, then runs the power-up
+		 * sequence and clears the panel.
+		 */
+		void __cheri_libcall lcd_init_finish(LCD_Interface *,
+		                                     St7735Context *,
+		                                     uint64_t resetStart);
 		void __cheri_libcall lcd_destroy(LCD_Interface *, St7735Context *);
 	} // namespace internal
 
@@ -65,26 +81,192 @@ namespace sonata::lcd
 			        (right + left + size.width) / 2,
 			        (bottom + top + size.height) / 2};
 		}
+
+		Rect translated(Point offset)
+		{
+			return {left + offset.x,
+			        top + offset.y,
+			        right + offset.x,
+			        bottom + offset.y};
+		}
+
+		/**
+		 * Returns the overlap of two rectangles.  If they do not overlap, the
+		 * result is empty but still has a valid (non-negative) size.
+		 */
+		Rect intersection(Rect other)
+		{
+			Rect result = {std::max(left, other.left),
+			               std::max(top, other.top),
+			               std::min(right, other.right),
+			               std::min(bottom, other.bottom)};
+			result.right  = std::max(result.left, result.right);
+			result.bottom = std::max(result.top, result.bottom);
+			return result;
+		}
+
+		bool is_empty()
+		{
+			return right <= left || bottom <= top;
+		}
 	};
 
-	enum class Color : uint32_t
+	/**
+	 * A colour, held as the RGB565 value that the panel uses natively and
+	 * that `SonataLcd::draw_image_rgb565` expects, so that drawing with it
+	 * needs no conversion.  Colours are built from 8-bit channels at compile
+	 * time with `from_rgb`.
+	 */
+	class Color
 	{
-		Black = 0x000000,
-		White = 0xFFFFFF,
-		Red   = 0x0000FF,
-		Green = 0x00FF00
+		uint16_t rgb565;
+
+		constexpr explicit Color(uint16_t value) : rgb565(value) {}
+
+		public:
+		/// Black, so that draw calls can be stored before being filled in.
+		constexpr Color() : rgb565(0) {}
+
+		static constexpr Color
+		from_rgb(uint8_t red, uint8_t green, uint8_t blue)
+		{
+			return Color{static_cast<uint16_t>(
+			  ((red & 0xF8) << 8) | ((green & 0xFC) << 3) | (blue >> 3))};
+		}
+
+		static constexpr Color from_rgb565(uint16_t value)
+		{
+			return Color{value};
+		}
+
+		constexpr uint16_t to_rgb565() const
+		{
+			return rgb565;
+		}
+
+		/**
+		 * Returns the colour as a 24-bit value with red in the low byte and
+		 * blue in the high byte, as the display driver's text functions
+		 * take it.  The low bits of each channel are filled from the high
+		 * bits, so white stays white.
+		 */
+		constexpr uint32_t to_bgr888() const
+		{
+			const uint32_t Red   = (rgb565 >> 11) & 0x1F;
+			const uint32_t Green = (rgb565 >> 5) & 0x3F;
+			const uint32_t Blue  = rgb565 & 0x1F;
+			return ((Red << 3) | (Red >> 2)) |
+			       (((Green << 2) | (Green >> 4)) << 8) |
+			       (((Blue << 3) | (Blue >> 2)) << 16);
+		}
+
+		constexpr bool operator==(const Color &) const = default;
+
+		static const Color Black;
+		static const Color White;
+		static const Color Red;
+		static const Color Green;
+		static const Color Blue;
+	};
+
+	inline constexpr const Color Color::Black = Color::from_rgb(0, 0, 0);
+	inline constexpr const Color Color::White = Color::from_rgb(255, 255, 255);
+	inline constexpr const Color Color::Red   = Color::from_rgb(255, 0, 0);
+	inline constexpr const Color Color::Green = Color::from_rgb(0, 255, 0);
+	inline constexpr const Color Color::Blue  = Color::from_rgb(0, 0, 255);
+
+	/**
+	 * Returns the advance, in pixels, of a character in the font used for
+	 * text, or zero if the font does not contain it.
+	 */
+	uint32_t __cheri_libcall glyph_width(char character);
+	/// Returns the height, in pixels, of the font used for text.
+	uint32_t __cheri_libcall font_height();
+
+	/**
+	 * A run of `length` opaque pixels, starting at column `start` of the
+	 * given `row` of a sprite.
+	 */
+	struct SpriteSpan
+	{
+		uint8_t row;
+		uint8_t start;
+		uint8_t length;
 	};
 
+	/**
+	 * An RGB565 image, laid out as for `SonataLcd::draw_image_rgb565`, that
+	 * can be drawn with a transparent colour key and scaled.  Sprites may be
+	 * at most 255 pixels wide and high.
+	 */
+	struct Sprite
+	{
+		Size           size;
+		const uint8_t *data;
+
+		/**
+		 * Find the runs of pixels that are not the `key` colour, in row
+		 * order, so that blits can skip transparent pixels without testing
+		 * each one.  Writes at most `maxSpans` spans and returns the number
+		 * of spans the sprite needs, which may be larger.
+		 */
+		size_t __cheri_libcall opaque_spans(Color       key,
+		                                    SpriteSpan *spans,
+		                                    size_t      maxSpans) const;
+	};
+
+	/**
+	 * A source of image data for `SonataLcd::draw_image_rgb565`.
+	 */
+	using ImageReader = void (*)(void    *context,
+	                             size_t   offset,
+	                             uint8_t *buffer,
+	                             size_t   length);
+
 	class SonataLcd
 	{
+		public:
+		/// The largest number of vertices accepted by `fill_polygon`.
+		static constexpr size_t MaxPolygonVertices = 32;
+		/// The size of the chunks in which streamed images are drawn.
+		static constexpr size_t ImageChunkSize = 256;
+
 		private:
 		internal::LCD_Interface lcdIntf;
 		internal::St7735Context ctx;
+		Rect                    viewport;
+		uint64_t                resetStart;
 
 		public:
-		SonataLcd()
+		/// Tag selecting the constructor that only starts initialisation.
+		struct DeferInit
+		{
+		};
+
+		SonataLcd() : SonataLcd(DeferInit{})
+		{
+			finish_init();
+		}
+
+		/**
+		 * Start initialising the display by putting it into reset, and
+		 * return without waiting.  `finish_init` must be called before any
+		 * other method, but the caller can do other work first, which
+		 * overlaps with the reset period.
+		 */
+		SonataLcd(DeferInit) : resetStart(internal::lcd_init_start(&lcdIntf))
+		{
+		}
+
+		/**
+		 * Complete initialisation started by the `DeferInit` constructor.
+		 * This sleeps through the rest of the reset period and the delays
+		 * of the power-up sequence.
+		 */
+		void finish_init()
 		{
-			internal::lcd_init(&lcdIntf, &ctx);
+			internal::lcd_init_finish(&lcdIntf, &ctx, resetStart);
+			viewport = Rect::from_point_and_size(Point::ORIGIN, resolution());
 		}
 
 		Size resolution()
@@ -96,16 +278,294 @@ namespace sonata::lcd
 		{
 			internal::lcd_destroy(&lcdIntf, &ctx);
 		}
+		/**
+		 * Restrict drawing to `rect`, which also becomes the origin of the
+		 * coordinates given to every drawing function.  Anything drawn
+		 * outside it is clipped, and `clean` fills only the viewport.  Text
+		 * is clipped to whole glyphs.  The viewport defaults to the whole
+		 * display, which `resolution` always reports.
+		 */
+		void __cheri_libcall set_viewport(Rect rect);
 		void __cheri_libcall clean();
 		void __cheri_libcall clean(Color color);
 		void __cheri_libcall draw_pixel(Point point, Color color);
+		/**
+		 * Draw a line between `a` and `b`, inclusive of both end points.
+		 * Arbitrary lines are rasterised with Bresenham's algorithm and
+		 * written as one window per horizontal or vertical run of pixels,
+		 * rather than one window per pixel.
+		 */
 		void __cheri_libcall draw_line(Point a, Point b, Color color);
+		/**
+		 * Draw connected lines between `count` consecutive points.
+		 */
+		void __cheri_libcall draw_polyline(const Point *points,
+		                                   size_t       count,
+		                                   Color        color);
+		/**
+		 * Draw the one pixel wide outline of a rectangle.
+		 */
+		void __cheri_libcall draw_rect(Rect rect, Color color);
+		/**
+		 * Draw the one pixel wide outline of a circle.
+		 */
+		void __cheri_libcall draw_circle(Point    center,
+		                                 uint32_t radius,
+		                                 Color    color);
+		/**
+		 * Fill a circle, including its outline.
+		 */
+		void __cheri_libcall fill_circle(Point    center,
+		                                 uint32_t radius,
+		                                 Color    color);
+		/**
+		 * Fill a simple or self-intersecting polygon using the even-odd
+		 * rule.  Polygons with fewer than three or more than
+		 * `MaxPolygonVertices` vertices are not drawn.
+		 */
+		void __cheri_libcall fill_polygon(const Point *points,
+		                                  size_t       count,
+		                                  Color        color);
+		/**
+		 * Draw an image of 24-bit pixels, stored as blue, green then red
+		 * bytes.  Pixels are converted to RGB565 four at a time when the
+		 * data is word aligned.
+		 */
 		void __cheri_libcall draw_image_bgr(Rect rect, const uint8_t *data);
 		void __cheri_libcall draw_image_rgb565(Rect rect, const uint8_t *data);
+		/**
+		 * Draw an RGB565 image that isn't in memory, such as one in flash.
+		 * `read` is called with `context` to fetch `length` bytes of the
+		 * image, starting `offset` bytes in, into `buffer`.  Data is fetched
+		 * and written to the panel `ImageChunkSize` bytes at a time, in
+		 * order, so only one chunk is ever held in memory.
+		 */
+		void __cheri_libcall draw_image_rgb565(Rect        rect,
+		                                       ImageReader read,
+		                                       void       *context);
+		/**
+		 * Draw a sprite with its top-left corner at `point`, magnified by an
+		 * integer `scale`.  If `spans` is not null, only the `spanCount`
+		 * opaque spans it holds are drawn, one window write per span.
+		 */
+		void __cheri_libcall draw_sprite(Point             point,
+		                                 Sprite            sprite,
+		                                 const SpriteSpan *spans     = nullptr,
+		                                 size_t            spanCount = 0,
+		                                 uint32_t          scale     = 1);
+		/**
+		 * Draw a sprite stretched to fill `rect`, using nearest-neighbour
+		 * sampling.  As for `draw_sprite`, `spans` optionally restricts
+		 * drawing to the opaque parts of the sprite.  Destination rows that
+		 * sample the same sprite row are written as a single window.
+		 */
+		void __cheri_libcall
+		draw_sprite_scaled(Rect              rect,
+		                   Sprite            sprite,
+		                   const SpriteSpan *spans     = nullptr,
+		                   size_t            spanCount = 0);
 		void __cheri_libcall fill_rect(Rect rect, Color color);
 		void __cheri_libcall draw_str(Point       point,
 		                              const char *str,
 		                              Color       background,
 		                              Color       foreground);
+		/**
+		 * Draw a single glyph, filling its whole cell of `glyph_width` by
+		 * `font_height` pixels.
+		 */
+		void __cheri_libcall draw_char(Point point,
+		                               char  character,
+		                               Color background,
+		                               Color foreground);
+		/**
+		 * End a transfer that was cut short, such as by a fault, by
+		 * deasserting chip select and releasing the SPI bus if the calling
+		 * thread holds it.
+		 */
+		void __cheri_libcall abandon_transfer();
+	};
+
+	/**
+	 * A line of text that remembers what it last drew, so that changing it
+	 * redraws only the glyph cells that differ, and erases only what the old
+	 * text covered beyond the new text's end.  An incrementing counter
+	 * usually costs one or two glyphs.  The display can be anything with
+	 * `draw_char` and `fill_rect`, such as `SonataLcd` or `SharedLcd`.
+	 */
+	class TextLabel
+	{
+		public:
+		/// The longest text a label shows; longer text is truncated.
+		static constexpr size_t MaxLength = 40;
+
+		private:
+		Point    position;
+		Color    background;
+		Color    foreground;
+		char     shown[MaxLength + 1] = {};
+		uint32_t shownWidth           = 0;
+
+		public:
+		TextLabel(Point position   = Point::ORIGIN,
+		          Color background = Color::White,
+		          Color foreground = Color::Black)
+		  : position(position), background(background), foreground(foreground)
+		{
+		}
+
+		/**
+		 * Show `text`.  A glyph is redrawn only if it differs from the one
+		 * already shown in the same cell.
+		 */
+		template<typename Display>
+		void set_text(Display &lcd, const char *text)
+		{
+			// Glyph `i` of the shown text starts at `shownX`, and of the new
+			// text at `x`.  They share a cell only while these are equal.
+			uint32_t shownX     = position.x;
+			uint32_t x          = position.x;
+			bool     shownEnded = false;
+			size_t   length     = 0;
+			for (; length < MaxLength && text[length] != '\0'; length++)
+			{
+				const char Character = text[length];
+				if (shownEnded || shownX != x || shown[length] != Character)
+				{
+					lcd.draw_char(
+					  {x, position.y}, Character, background, foreground);
+				}
+				x += glyph_width(Character);
+				if (!shownEnded)
+				{
+					shownEnded = shown[length] == '\0';
+					shownX += glyph_width(shown[length]);
+				}
+			}
+
+			const uint32_t ShownEnd = position.x + shownWidth;
+			if (x < ShownEnd)
+			{
+				lcd.fill_rect(
+				  {x, position.y, ShownEnd, position.y + font_height()},
+				  background);
+			}
+			memcpy(shown, text, length);
+			shown[length] = '\0';
+			shownWidth    = x - position.x;
+		}
+
+		/**
+		 * Erase the label's text.
+		 */
+		template<typename Display>
+		void clear(Display &lcd)
+		{
+			if (shownWidth > 0)
+			{
+				lcd.fill_rect({position.x,
+				               position.y,
+				               position.x + shownWidth,
+				               position.y + font_height()},
+				              background);
+			}
+			invalidate();
+		}
+
+		/**
+		 * Forget what the label shows, without erasing it, so that the next
+		 * `set_text` draws every glyph.  Use this when something else has
+		 * drawn over the label.
+		 */
+		void invalidate()
+		{
+			shown[0]   = '\0';
+			shownWidth = 0;
+		}
+	};
+
+	/**
+	 * A scrolling plot of a time series, drawn one column per sample.  The
+	 * plot isn't shifted; instead its columns are used as a ring, with each
+	 * sample drawn over the oldest column and the column after it cleared to
+	 * mark where the trace is being written.  Each sample costs two
+	 * one-pixel-wide fills, however wide the chart is.  As for `TextLabel`,
+	 * the display can be `SonataLcd` or `SharedLcd`.
+	 */
+	class StripChart
+	{
+		Rect     bounds;
+		int32_t  minimum;
+		int32_t  maximum;
+		Color    background;
+		Color    foreground;
+		uint32_t column   = 0;
+		uint32_t lastY    = 0;
+		bool     hasLastY = false;
+
+		/**
+		 * Returns the row at which `value` is plotted, clamping it to the
+		 * chart's range.
+		 */
+		uint32_t row_for(int32_t value)
+		{
+			value                 = std::clamp(value, minimum, maximum);
+			const uint32_t Height = bounds.bottom - bounds.top;
+			const uint32_t Offset = static_cast<uint32_t>(value - minimum) *
+			                        (Height - 1) /
+			                        static_cast<uint32_t>(maximum - minimum);
+			return bounds.bottom - 1 - Offset;
+		}
+
+		public:
+		/**
+		 * A chart covering `bounds`, whose vertical axis runs from `minimum`
+		 * at the bottom to `maximum` at the top.
+		 */
+		StripChart(Rect    bounds,
+		           int32_t minimum,
+		           int32_t maximum,
+		           Color   background = Color::White,
+		           Color   foreground = Color::Black)
+		  : bounds(bounds),
+		    minimum(minimum),
+		    maximum(std::max(maximum, minimum + 1)),
+		    background(background),
+		    foreground(foreground)
+		{
+		}
+
+		/**
+		 * Erase the chart and start the trace again from its left edge.
+		 */
+		template<typename Display>
+		void clear(Display &lcd)
+		{
+			lcd.fill_rect(bounds, background);
+			column   = 0;
+			hasLastY = false;
+		}
+
+		/**
+		 * Plot the next sample, joined to the previous one by a vertical
+		 * line in the new column.
+		 */
+		template<typename Display>
+		void add_sample(Display &lcd, int32_t value)
+		{
+			const uint32_t Width = bounds.right - bounds.left;
+			const uint32_t X     = bounds.left + column;
+			const uint32_t Y     = row_for(value);
+			const uint32_t From  = hasLastY ? lastY : Y;
+			column               = (column + 1) % Width;
+			lcd.fill_rect({bounds.left + column,
+			               bounds.top,
+			               bounds.left + column + 1,
+			               bounds.bottom},
+			              background);
+			lcd.fill_rect({X, std::min(From, Y), X + 1, std::max(From, Y) + 1},
+			              foreground);
+			lastY    = Y;
+			hasLastY = true;
+		}
 	};
 } // namespace sonata::lcd
@@ -0,0 +1,586 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "lcd_service.hh"
+#include "asset_store.hh"
+#include <cheri.hh>
+#include <debug.hh>
+#include <errno.h>
+#include <futex.h>
+#include <limits>
+#include <locks.hh>
+#include <thread.h>
+#include <timeout.hh>
+#include <token.h>
+
+using namespace sonata::lcd;
+
+/// Expose debugging features unconditionally for this compartment.
+using Debug = ConditionalDebug<true, "lcd_service">;
+
+/**
+ * Ticks to wait for the display to become ready before giving up.  It takes
+ * well under a second, so a longer wait means that no thread is running
+ * `lcd_service_init`.
+ */
+static constexpr Ticks ReadyTimeout = 5 * TICK_RATE_HZ;
+
+/**
+ * The state behind a viewport handle: the region of the display, in screen
+ * coordinates, that the client may draw in.
+ */
+struct LcdViewport
+{
+	Rect bounds;
+};
+
+/// Serialises all access to the display.
+static FlagLockPriorityInherited lcdLock;
+/// The ID of the thread holding `lcdLock`, or zero if it is free.
+static uint16_t lockHolder;
+
+/**
+ * Holds `lcdLock` for its lifetime, noting the holder so that the error
+ * handler can release the lock if the holder faults.
+ */
+class DisplayGuard
+{
+	LockGuard<FlagLockPriorityInherited> guard{lcdLock};
+
+	public:
+	DisplayGuard()
+	{
+		lockHolder = thread_id_get();
+	}
+
+	~DisplayGuard()
+	{
+		lockHolder = 0;
+	}
+
+	DisplayGuard(const DisplayGuard &)            = delete;
+	DisplayGuard &operator=(const DisplayGuard &) = delete;
+};
+
+/**
+ * Futex word that becomes non-zero once the display has been initialised
+ * and every queued draw call has been made.
+ */
+static uint32_t displayReady;
+/// Set once a thread has started initialising the display.
+static bool initStarted;
+
+/// The kinds of draw call that can be queued before the display is ready.
+enum class DrawKind : uint8_t
+{
+	Clean,
+	Pixel,
+	Line,
+	Rectangle,
+	Circle,
+	FilledCircle,
+	FilledRectangle,
+	String,
+	Character,
+};
+
+/**
+ * A draw call, with its arguments and the bounds of the viewport it was made
+ * in.  Calls that take pointers to client memory are not queued, because
+ * the client may change or free the memory before the display is ready.
+ */
+struct DrawCall
+{
+	DrawKind kind;
+	Rect     bounds;
+	Point    a;
+	Point    b;
+	Rect     rect;
+	uint32_t radius;
+	Color    color;
+	Color    background;
+	char     text[MaxLcdStringLength + 1];
+};
+
+/// The number of draw calls that can be queued before the display is ready.
+static constexpr size_t MaxQueuedCalls = 8;
+/// Draw calls made before the display was ready, in the order they were made.
+static DrawCall queuedCalls[MaxQueuedCalls];
+static size_t   queuedCallCount;
+
+/**
+ * Get a token key for use sealing LcdViewports.
+ */
+static auto key()
+{
+	static auto key = token_key_new();
+	return key;
+}
+
+/**
+ * Get the display.  The first call starts initialising it, which is
+ * finished by `lcd_service_init`; other callers must wait for
+ * `displayReady` and hold `lcdLock`.
+ */
+static SonataLcd &lcd()
+{
+	static SonataLcd lcd{SonataLcd::DeferInit{}};
+	return lcd;
+}
+
+/**
+ * Releases the display if the faulting thread holds it, so that a fault
+ * while drawing, such as on client memory that was changed or freed after
+ * it was checked, can't leave every other client waiting forever.  That
+ * includes the SPI bus and chip select, which are held while a transfer
+ * is under way.  The call that faulted is then unwound.
+ */
+extern "C" ErrorRecoveryBehaviour
+compartment_error_handler(ErrorState *frame, size_t mcause, size_t mtval)
+{
+	if (lockHolder != 0 && lockHolder == thread_id_get())
+	{
+		lcd().abandon_transfer();
+		lockHolder = 0;
+		lcdLock.unlock();
+	}
+	return ErrorRecoveryBehaviour::ForceUnwind;
+}
+
+/**
+ * Helper.  Returns whether `points` holds `count` readable points.
+ */
+static bool check_points(const Point *points, size_t count)
+{
+	size_t bytes;
+	return !__builtin_mul_overflow(count, sizeof(Point), &bytes) &&
+	       CHERI::check_pointer(points, bytes);
+}
+
+/**
+ * Block until the display is ready, for at most `ReadyTimeout` ticks.
+ * Returns whether it is ready.
+ */
+static bool wait_until_ready()
+{
+	Timeout timeout{ReadyTimeout};
+	while (__atomic_load_n(&displayReady, __ATOMIC_ACQUIRE) == 0)
+	{
+		if (futex_timed_wait(&timeout, &displayReady, 0) == -ETIMEDOUT)
+		{
+			Debug::log("The display isn't ready; is a thread running "
+			           "lcd_service_init?");
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Unseal a handle with our viewport token key.
+ */
+static LcdViewport *unseal_viewport(LcdViewport *viewport)
+{
+	return token_unseal(key(), Sealed<LcdViewport>{viewport});
+}
+
+/**
+ * Helper.  Makes a draw call on the display.
+ */
+static void execute(SonataLcd &display, const DrawCall &call)
+{
+	display.set_viewport(call.bounds);
+	switch (call.kind)
+	{
+		case DrawKind::Clean:
+			display.clean(call.color);
+			break;
+		case DrawKind::Pixel:
+			display.draw_pixel(call.a, call.color);
+			break;
+		case DrawKind::Line:
+			display.draw_line(call.a, call.b, call.color);
+			break;
+		case DrawKind::Rectangle:
+			display.draw_rect(call.rect, call.color);
+			break;
+		case DrawKind::Circle:
+			display.draw_circle(call.a, call.radius, call.color);
+			break;
+		case DrawKind::FilledCircle:
+			display.fill_circle(call.a, call.radius, call.color);
+			break;
+		case DrawKind::FilledRectangle:
+			display.fill_rect(call.rect, call.color);
+			break;
+		case DrawKind::String:
+			display.draw_str(call.a, call.text, call.background, call.color);
+			break;
+		case DrawKind::Character:
+			display.draw_char(
+			  call.a, call.text[0], call.background, call.color);
+			break;
+	}
+}
+
+/**
+ * Helper.  Unseals `viewport` and, if it is valid, makes `call` in it.  If
+ * the display is not ready yet, the call is queued instead, unless the
+ * queue is full, in which case this waits for the display.  Returns whether
+ * the handle was valid.
+ */
+static bool submit(LcdViewport *viewport, DrawCall &call)
+{
+	auto *unsealed = unseal_viewport(viewport);
+	if (unsealed == nullptr)
+	{
+		return false;
+	}
+	call.bounds = unsealed->bounds;
+	while (true)
+	{
+		{
+			DisplayGuard guard;
+			if (displayReady != 0)
+			{
+				execute(lcd(), call);
+				return true;
+			}
+			if (queuedCallCount < MaxQueuedCalls)
+			{
+				queuedCalls[queuedCallCount++] = call;
+				return true;
+			}
+		}
+		if (!wait_until_ready())
+		{
+			return false;
+		}
+	}
+}
+
+/**
+ * Helper.  Unseals `viewport` and, if it is valid, waits for the display to
+ * be ready and calls `draw` on it with the viewport applied and the display
+ * lock held.  Returns whether the handle was valid.
+ */
+static bool draw_in(LcdViewport *viewport, auto &&draw)
+{
+	auto *unsealed = unseal_viewport(viewport);
+	if (unsealed == nullptr)
+	{
+		return false;
+	}
+	if (!wait_until_ready())
+	{
+		return false;
+	}
+	DisplayGuard guard;
+	lcd().set_viewport(unsealed->bounds);
+	draw(lcd());
+	return true;
+}
+
+void lcd_service_init()
+{
+	{
+		DisplayGuard guard;
+		if (initStarted)
+		{
+			return;
+		}
+		initStarted = true;
+	}
+
+	// Nothing else touches the display until it is ready, so the lock
+	// needn't be held while sleeping through the power-up sequence.
+	SonataLcd &display = lcd();
+	display.finish_init();
+
+	DisplayGuard guard;
+	for (size_t i = 0; i < queuedCallCount; i++)
+	{
+		execute(display, queuedCalls[i]);
+	}
+	queuedCallCount = 0;
+	__atomic_store_n(&displayReady, 1, __ATOMIC_RELEASE);
+	futex_wake(&displayReady, std::numeric_limits<uint32_t>::max());
+}
+
+Size lcd_resolution()
+{
+	if (!wait_until_ready())
+	{
+		return {0, 0};
+	}
+	DisplayGuard guard;
+	return lcd().resolution();
+}
+
+LcdViewport *lcd_viewport_open(Rect bounds)
+{
+	if (bounds.is_empty())
+	{
+		return nullptr;
+	}
+
+	auto [unsealed, sealed] =
+	  blocking_forever<token_allocate<LcdViewport>>(MALLOC_CAPABILITY, key());
+	if (sealed == nullptr)
+	{
+		return nullptr;
+	}
+	unsealed->bounds = bounds;
+	return sealed.get();
+}
+
+void lcd_viewport_close(LcdViewport *viewport)
+{
+	// The allocator checks validity before destroying so we don't have to.
+	token_obj_destroy(
+	  MALLOC_CAPABILITY, key(), reinterpret_cast<SObj>(viewport));
+}
+
+Size lcd_viewport_size(LcdViewport *viewport)
+{
+	auto *unsealed = unseal_viewport(viewport);
+	if (unsealed == nullptr)
+	{
+		return {0, 0};
+	}
+	const Rect Visible = unsealed->bounds.intersection(
+	  Rect::from_point_and_size(Point::ORIGIN, lcd_resolution()));
+	return {Visible.right - Visible.left, Visible.bottom - Visible.top};
+}
+
+bool lcd_clean(LcdViewport *viewport, Color color)
+{
+	DrawCall call = {.kind = DrawKind::Clean, .color = color};
+	return submit(viewport, call);
+}
+
+bool lcd_draw_pixel(LcdViewport *viewport, Point point, Color color)
+{
+	DrawCall call = {.kind = DrawKind::Pixel, .a = point, .color = color};
+	return submit(viewport, call);
+}
+
+bool lcd_draw_line(LcdViewport *viewport, Point a, Point b, Color color)
+{
+	DrawCall call = {.kind = DrawKind::Line, .a = a, .b = b, .color = color};
+	return submit(viewport, call);
+}
+
+bool lcd_draw_polyline(LcdViewport *viewport,
+                       const Point *points,
+                       size_t       count,
+                       Color        color)
+{
+	if (!check_points(points, count))
+	{
+		return false;
+	}
+	return draw_in(viewport, [&](SonataLcd &display) {
+		display.draw_polyline(points, count, color);
+	});
+}
+
+bool lcd_draw_rect(LcdViewport *viewport, Rect rect, Color color)
+{
+	DrawCall call = {
+	  .kind = DrawKind::Rectangle, .rect = rect, .color = color};
+	return submit(viewport, call);
+}
+
+bool lcd_draw_circle(LcdViewport *viewport,
+                     Point        center,
+                     uint32_t     radius,
+                     Color        color)
+{
+	DrawCall call = {.kind   = DrawKind::Circle,
+	                 .a      = center,
+	                 .radius = radius,
+	                 .color  = color};
+	return submit(viewport, call);
+}
+
+bool lcd_fill_circle(LcdViewport *viewport,
+                     Point        center,
+                     uint32_t     radius,
+                     Color        color)
+{
+	DrawCall call = {.kind   = DrawKind::FilledCircle,
+	                 .a      = center,
+	                 .radius = radius,
+	                 .color  = color};
+	return submit(viewport, call);
+}
+
+bool lcd_fill_polygon(LcdViewport *viewport,
+                      const Point *points,
+                      size_t       count,
+                      Color        color)
+{
+	if (!check_points(points, count))
+	{
+		return false;
+	}
+	return draw_in(viewport, [&](SonataLcd &display) {
+		display.fill_polygon(points, count, color);
+	});
+}
+
+bool lcd_fill_rect(LcdViewport *viewport, Rect rect, Color color)
+{
+	DrawCall call = {
+	  .kind = DrawKind::FilledRectangle, .rect = rect, .color = color};
+	return submit(viewport, call);
+}
+
+/**
+ * Helper.  Returns whether `data` holds a readable image filling `rect` with
+ * `bytesPerPixel` bytes per pixel.
+ */
+static bool check_image(Rect rect, const uint8_t *data, size_t bytesPerPixel)
+{
+	if (rect.is_empty())
+	{
+		return true;
+	}
+	size_t bytes;
+	return !__builtin_mul_overflow(static_cast<size_t>(rect.right - rect.left),
+	                               static_cast<size_t>(rect.bottom - rect.top),
+	                               &bytes) &&
+	       !__builtin_mul_overflow(bytes, bytesPerPixel, &bytes) &&
+	       CHERI::check_pointer(data, bytes);
+}
+
+bool lcd_draw_image_rgb565(LcdViewport   *viewport,
+                           Rect           rect,
+                           const uint8_t *data)
+{
+	if (!check_image(rect, data, 2))
+	{
+		return false;
+	}
+	return draw_in(viewport, [&](SonataLcd &display) {
+		display.draw_image_rgb565(rect, data);
+	});
+}
+
+bool lcd_draw_image_bgr(LcdViewport *viewport, Rect rect, const uint8_t *data)
+{
+	if (!check_image(rect, data, 3))
+	{
+		return false;
+	}
+	return draw_in(viewport, [&](SonataLcd &display) {
+		display.draw_image_bgr(rect, data);
+	});
+}
+
+bool lcd_draw_sprite_scaled(LcdViewport      *viewport,
+                            Rect              rect,
+                            Sprite            sprite,
+                            const SpriteSpan *spans,
+                            size_t            spanCount)
+{
+	size_t spanBytes;
+	if (!check_image(Rect::from_point_and_size(Point::ORIGIN, sprite.size),
+	                 sprite.data,
+	                 2) ||
+	    (spans != nullptr &&
+	     (__builtin_mul_overflow(spanCount, sizeof(SpriteSpan), &spanBytes) ||
+	      !CHERI::check_pointer(spans, spanBytes))))
+	{
+		return false;
+	}
+	// Each span is used to index the sprite's pixels, so must lie within it.
+	for (size_t i = 0; spans != nullptr && i < spanCount; i++)
+	{
+		const SpriteSpan Span = spans[i];
+		if (Span.row >= sprite.size.height ||
+		    Span.start + Span.length > sprite.size.width)
+		{
+			return false;
+		}
+	}
+	return draw_in(viewport, [&](SonataLcd &display) {
+		display.draw_sprite_scaled(rect, sprite, spans, spanCount);
+	});
+}
+
+bool lcd_draw_str(LcdViewport *viewport,
+                  Point        point,
+                  const char  *str,
+                  size_t       length,
+                  Color        background,
+                  Color        foreground)
+{
+	length = std::min(length, MaxLcdStringLength);
+	if (!CHERI::check_pointer(str, length))
+	{
+		return false;
+	}
+	// Copy the string so that the client can't change it, or remove its
+	// terminator, while it is being drawn.  This also lets it be queued.
+	DrawCall call = {.kind       = DrawKind::String,
+	                 .a          = point,
+	                 .color      = foreground,
+	                 .background = background};
+	memcpy(call.text, str, length);
+	call.text[length] = '\0';
+	return submit(viewport, call);
+}
+
+bool lcd_draw_char(LcdViewport *viewport,
+                   Point        point,
+                   char         character,
+                   Color        background,
+                   Color        foreground)
+{
+	DrawCall call = {.kind       = DrawKind::Character,
+	                 .a          = point,
+	                 .color      = foreground,
+	                 .background = background,
+	                 .text       = {character}};
+	return submit(viewport, call);
+}
+
+bool lcd_draw_asset(LcdViewport *viewport,
+                    Point        point,
+                    const char  *name,
+                    size_t       nameLength)
+{
+	if (nameLength > sonata::flash::AssetStore::MaxNameLength ||
+	    !CHERI::check_pointer(name, nameLength))
+	{
+		return false;
+	}
+	char copiedName[sonata::flash::AssetStore::MaxNameLength + 1];
+	memcpy(copiedName, name, nameLength);
+	copiedName[nameLength] = '\0';
+
+	bool drawn = false;
+	bool valid = draw_in(viewport, [&](SonataLcd &display) {
+		// The flash shares the GPIO output register with the display, so it
+		// is only used with the display lock held.
+		static sonata::flash::SpiFlash   flash;
+		static sonata::flash::AssetStore store{flash};
+		static bool                      storeOpen = false;
+		// A failed open is retried by the next draw, rather than kept.
+		if (!storeOpen)
+		{
+			storeOpen = store.open();
+		}
+		if (!storeOpen)
+		{
+			return;
+		}
+		if (auto asset = store.find(copiedName))
+		{
+			drawn = store.draw(display, point, *asset);
+		}
+	});
+	return valid && drawn;
+}
@@ -0,0 +1,277 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <compartment.h>
+#include <cstring>
+
+#include "lcd.hh"
+
+/**
+ * A sealed handle granting a client the right to draw within one region of
+ * the display.  Only the `lcd_service` compartment can unseal it.
+ */
+struct LcdViewport;
+
+/**
+ * The interface of the `lcd_service` compartment, which owns the display.
+ * Every draw call is made under a single lock so that clients never
+ * interleave their SPI transactions.  Coordinates passed with a viewport
+ * are relative to its top-left corner, and drawing is clipped to it.  Calls
+ * taking a viewport return false if the handle is not valid or a buffer is
+ * not readable.
+ *
+ * The display is brought up in the background by `lcd_service_init`, so
+ * clients can open viewports and draw straight away.  Until it is ready,
+ * draw calls that don't take buffers (everything but polylines, polygons,
+ * images and sprites) are queued and return immediately; the others, and
+ * any call that finds the queue full, wait for the display.  They wait for
+ * at most five seconds, and then fail, so firmware that doesn't run
+ * `lcd_service_init` reports the mistake rather than hanging.
+ */
+
+/**
+ * Initialise the display, sleeping through its reset and power-up delays,
+ * then make any queued draw calls.  Firmware using the service must run
+ * this as the entry point of a thread; later calls return immediately.
+ */
+__cheri_compartment("lcd_service") void lcd_service_init();
+/**
+ * Returns the size of the whole display, waiting for it to be ready, or a
+ * size of zero if it doesn't become ready.
+ */
+__cheri_compartment("lcd_service") sonata::lcd::Size lcd_resolution();
+/**
+ * Opens a viewport covering `bounds`.  Drawing is also clipped to the
+ * display.  Returns nullptr if the bounds are empty or the handle can't be
+ * allocated.
+ */
+__cheri_compartment("lcd_service") LcdViewport *lcd_viewport_open(
+  sonata::lcd::Rect bounds);
+__cheri_compartment("lcd_service") void lcd_viewport_close(LcdViewport *);
+/**
+ * Returns the size of the visible part of a viewport, or zero if the handle
+ * is not valid.  This waits for the display to be ready.
+ */
+__cheri_compartment("lcd_service") sonata::lcd::Size lcd_viewport_size(
+  LcdViewport *);
+__cheri_compartment("lcd_service") bool lcd_clean(LcdViewport *,
+                                                   sonata::lcd::Color color);
+__cheri_compartment("lcd_service") bool lcd_draw_pixel(
+  LcdViewport *,
+  sonata::lcd::Point point,
+  sonata::lcd::Color color);
+__cheri_compartment("lcd_service") bool lcd_draw_line(
+  LcdViewport *,
+  sonata::lcd::Point a,
+  sonata::lcd::Point b,
+  sonata::lcd::Color color);
+__cheri_compartment("lcd_service") bool lcd_draw_polyline(
+  LcdViewport *,
+  const sonata::lcd::Point *points,
+  size_t                    count,
+  sonata::lcd::Color        color);
+__cheri_compartment("lcd_service") bool lcd_draw_rect(
+  LcdViewport *,
+  sonata::lcd::Rect  rect,
+  sonata::lcd::Color color);
+__cheri_compartment("lcd_service") bool lcd_draw_circle(
+  LcdViewport *,
+  sonata::lcd::Point center,
+  uint32_t           radius,
+  sonata::lcd::Color color);
+__cheri_compartment("lcd_service") bool lcd_fill_circle(
+  LcdViewport *,
+  sonata::lcd::Point center,
+  uint32_t           radius,
+  sonata::lcd::Color color);
+__cheri_compartment("lcd_service") bool lcd_fill_polygon(
+  LcdViewport *,
+  const sonata::lcd::Point *points,
+  size_t                    count,
+  sonata::lcd::Color        color);
+__cheri_compartment("lcd_service") bool lcd_fill_rect(
+  LcdViewport *,
+  sonata::lcd::Rect  rect,
+  sonata::lcd::Color color);
+__cheri_compartment("lcd_service") bool lcd_draw_image_rgb565(
+  LcdViewport *,
+  sonata::lcd::Rect rect,
+  const uint8_t    *data);
+__cheri_compartment("lcd_service") bool lcd_draw_image_bgr(
+  LcdViewport *,
+  sonata::lcd::Rect rect,
+  const uint8_t    *data);
+__cheri_compartment("lcd_service") bool lcd_draw_sprite_scaled(
+  LcdViewport *,
+  sonata::lcd::Rect              rect,
+  sonata::lcd::Sprite            sprite,
+  const sonata::lcd::SpriteSpan *spans,
+  size_t                         spanCount);
+/**
+ * Draws `length` characters of `str`, which need not be null terminated.
+ * At most `MaxLcdStringLength` characters are drawn.
+ */
+__cheri_compartment("lcd_service") bool lcd_draw_str(
+  LcdViewport *,
+  sonata::lcd::Point point,
+  const char        *str,
+  size_t             length,
+  sonata::lcd::Color background,
+  sonata::lcd::Color foreground);
+__cheri_compartment("lcd_service") bool lcd_draw_char(
+  LcdViewport *,
+  sonata::lcd::Point point,
+  char               character,
+  sonata::lcd::Color background,
+  sonata::lcd::Color foreground);
+/**
+ * Draws the RGB565 image asset called `name` from the SPI flash asset store
+ * with its top-left corner at `point`, streaming it to the panel without
+ * copying it to memory.  `name` need not be null terminated.  Returns false
+ * if there is no such image.
+ */
+__cheri_compartment("lcd_service") bool lcd_draw_asset(
+  LcdViewport *,
+  sonata::lcd::Point point,
+  const char        *name,
+  size_t             nameLength);
+
+/// The longest string accepted by `lcd_draw_str`.
+static constexpr size_t MaxLcdStringLength = 64;
+
+namespace sonata::lcd
+{
+	/**
+	 * A client of the `lcd_service` compartment, owning one viewport.  This
+	 * offers the drawing functions of `SonataLcd`, in the viewport's
+	 * coordinates, so that code can move between the two easily.
+	 */
+	class SharedLcd
+	{
+		LcdViewport *viewport;
+
+		public:
+		/**
+		 * Open a viewport covering `bounds`.  Check `is_valid` before
+		 * drawing: draw calls on an invalid viewport do nothing.
+		 */
+		SharedLcd(Rect bounds) : viewport(lcd_viewport_open(bounds)) {}
+
+		SharedLcd(const SharedLcd &)            = delete;
+		SharedLcd &operator=(const SharedLcd &) = delete;
+
+		~SharedLcd()
+		{
+			if (viewport != nullptr)
+			{
+				lcd_viewport_close(viewport);
+			}
+		}
+
+		/**
+		 * Returns the size of the whole display, for choosing the bounds of
+		 * a viewport.  This waits for the display to be ready, and returns
+		 * a size of zero if it doesn't become ready.
+		 */
+		static Size display_resolution()
+		{
+			return lcd_resolution();
+		}
+
+		bool is_valid()
+		{
+			return viewport != nullptr;
+		}
+
+		Size resolution()
+		{
+			return lcd_viewport_size(viewport);
+		}
+
+		void clean(Color color = Color::White)
+		{
+			lcd_clean(viewport, color);
+		}
+
+		void draw_pixel(Point point, Color color)
+		{
+			lcd_draw_pixel(viewport, point, color);
+		}
+
+		void draw_line(Point a, Point b, Color color)
+		{
+			lcd_draw_line(viewport, a, b, color);
+		}
+
+		void draw_polyline(const Point *points, size_t count, Color color)
+		{
+			lcd_draw_polyline(viewport, points, count, color);
+		}
+
+		void draw_rect(Rect rect, Color color)
+		{
+			lcd_draw_rect(viewport, rect, color);
+		}
+
+		void draw_circle(Point center, uint32_t radius, Color color)
+		{
+			lcd_draw_circle(viewport, center, radius, color);
+		}
+
+		void fill_circle(Point center, uint32_t radius, Color color)
+		{
+			lcd_fill_circle(viewport, center, radius, color);
+		}
+
+		void fill_polygon(const Point *points, size_t count, Color color)
+		{
+			lcd_fill_polygon(viewport, points, count, color);
+		}
+
+		void fill_rect(Rect rect, Color color)
+		{
+			lcd_fill_rect(viewport, rect, color);
+		}
+
+		void draw_image_rgb565(Rect rect, const uint8_t *data)
+		{
+			lcd_draw_image_rgb565(viewport, rect, data);
+		}
+
+		void draw_image_bgr(Rect rect, const uint8_t *data)
+		{
+			lcd_draw_image_bgr(viewport, rect, data);
+		}
+
+		void draw_sprite_scaled(Rect              rect,
+		                        Sprite            sprite,
+		                        const SpriteSpan *spans     = nullptr,
+		                        size_t            spanCount = 0)
+		{
+			lcd_draw_sprite_scaled(viewport, rect, sprite, spans, spanCount);
+		}
+
+		void draw_str(Point       point,
+		              const char *str,
+		              Color       background,
+		              Color       foreground)
+		{
+			lcd_draw_str(
+			  viewport, point, str, strlen(str), background, foreground);
+		}
+
+		bool draw_asset(Point point, const char *name)
+		{
+			return lcd_draw_asset(viewport, point, name, strlen(name));
+		}
+
+		void draw_char(Point point,
+		               char  character,
+		               Color background,
+		               Color foreground)
+		{
+			lcd_draw_char(viewport, point, character, background, foreground);
+		}
+	};
+} // namespace sonata::lcd
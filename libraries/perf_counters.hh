@@ -0,0 +1,233 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <utility>
+
+#include "format.hh"
+
+/**
+ * Reads the Ibex core's performance counters, to explain why code is slow
+ * rather than only how long it takes.
+ *
+ * Ibex hardwires each of its counters to one event, so there is nothing to
+ * select: the counters run from reset, and are read through the same
+ * unprivileged aliases as `rdcycle64` uses, which any compartment may read.
+ * Ibex predicts no branches, so the nearest it has to mispredictions is
+ * taken branches, each of which flushes the fetch stage.  A counter that
+ * the core is built without reads as zero.
+ *
+ * Counts are attributed to named sections by scoped regions:
+ *
+ *     static sonata::perf::Section drawing{"drawing"};
+ *     {
+ *         sonata::perf::ScopedRegion region{drawing};
+ *         ...
+ *     }
+ *
+ * A region's counts include those of any regions nested inside it, and of
+ * anything else that runs while it is open, such as other threads.
+ */
+namespace sonata::perf
+{
+	/// The events counted.
+	enum class Event : uint8_t
+	{
+		Cycles,
+		InstructionsRetired,
+		/// Cycles waiting for loads and stores to complete.
+		LoadStoreWaitCycles,
+		/// Cycles waiting for instructions to be fetched.
+		FetchWaitCycles,
+		Loads,
+		Stores,
+		/// Unconditional jumps.
+		Jumps,
+		/// Conditional branches.
+		Branches,
+		/// Conditional branches taken.
+		BranchesTaken,
+		/// Compressed instructions retired.
+		CompressedInstructions,
+		/// Cycles waiting for multiplications to complete.
+		MultiplyWaitCycles,
+		/// Cycles waiting for divisions to complete.
+		DivideWaitCycles,
+	};
+
+	/// The number of events counted.
+	static constexpr size_t EventCount = 12;
+
+	/// The short names of the events, as used in reports.
+	static constexpr const char *EventNames[EventCount] = {
+	  "cycles",
+	  "instret",
+	  "lsu_wait",
+	  "fetch_wait",
+	  "loads",
+	  "stores",
+	  "jumps",
+	  "branches",
+	  "taken",
+	  "compressed",
+	  "mul_wait",
+	  "div_wait",
+	};
+
+	/**
+	 * The unprivileged CSR through which each event's counter is read:
+	 * `cycle`, `instret`, then `hpmcounter3` onwards, in the order Ibex
+	 * assigns them.
+	 */
+	static constexpr uint16_t EventCsrs[EventCount] = {
+	  0xc00,
+	  0xc02,
+	  0xc03,
+	  0xc04,
+	  0xc05,
+	  0xc06,
+	  0xc07,
+	  0xc08,
+	  0xc09,
+	  0xc0a,
+	  0xc0b,
+	  0xc0c,
+	};
+
+	/**
+	 * Returns the 64-bit value of the counter read through the CSR `Csr`,
+	 * rereading if the high word changed while the low word was read, as
+	 * `rdcycle64` does.
+	 */
+	template<uint16_t Csr>
+	[[gnu::always_inline]] inline uint64_t read_counter()
+	{
+		constexpr uint16_t High = Csr + 0x80;
+		uint32_t           high, low, highAgain;
+		do
+		{
+			asm volatile("csrr %0, %1" : "=r"(high) : "i"(High));
+			asm volatile("csrr %0, %1" : "=r"(low) : "i"(Csr));
+			asm volatile("csrr %0, %1" : "=r"(highAgain) : "i"(High));
+		} while (high != highAgain);
+		return (static_cast<uint64_t>(high) << 32) | low;
+	}
+
+	/// A reading of every counter.
+	struct Counters
+	{
+		uint64_t values[EventCount] = {};
+
+		/// Reads every counter.
+		[[gnu::always_inline]] static Counters read()
+		{
+			return read(std::make_index_sequence<EventCount>());
+		}
+
+		uint64_t operator[](Event event) const
+		{
+			return values[static_cast<size_t>(event)];
+		}
+
+		Counters operator-(const Counters &other) const
+		{
+			Counters difference;
+			for (size_t i = 0; i < EventCount; i++)
+			{
+				difference.values[i] = values[i] - other.values[i];
+			}
+			return difference;
+		}
+
+		Counters &operator+=(const Counters &other)
+		{
+			for (size_t i = 0; i < EventCount; i++)
+			{
+				values[i] += other.values[i];
+			}
+			return *this;
+		}
+
+		private:
+		template<size_t... Indices>
+		[[gnu::always_inline]] static Counters
+		read(std::index_sequence<Indices...>)
+		{
+			return {{read_counter<EventCsrs[Indices]>()...}};
+		}
+	};
+
+	/**
+	 * A named section of code, and the counts of the regions that have
+	 * been attributed to it.
+	 */
+	struct Section
+	{
+		const char *name;
+		Counters    totals  = {};
+		uint32_t    entries = 0;
+
+		constexpr explicit Section(const char *name) : name(name) {}
+
+		/// Adds the counts of one region.
+		void add(const Counters &counts)
+		{
+			totals += counts;
+			entries++;
+		}
+
+		/// Forgets the counts so far.
+		void reset()
+		{
+			totals  = {};
+			entries = 0;
+		}
+
+		/**
+		 * Writes a report of the section to `buffer`, which holds
+		 * `capacity` bytes, as its name, the number of regions and the mean
+		 * count of each event per region, as `key=value` pairs.  Returns
+		 * the length written, as `format::format_to`.
+		 */
+		size_t report(char *buffer, size_t capacity) const
+		{
+			format::Writer writer{buffer, capacity};
+			format::format_to(writer, "section={} entries={}", name, entries);
+			for (size_t i = 0; i < EventCount; i++)
+			{
+				format::format_to(writer,
+				                  " {}={}",
+				                  EventNames[i],
+				                  entries == 0 ? uint64_t{0}
+				                               : totals.values[i] / entries);
+			}
+			return writer.length();
+		}
+	};
+
+	/**
+	 * Attributes the counts from its construction to its destruction to a
+	 * section.
+	 */
+	class ScopedRegion
+	{
+		Section &section;
+		Counters start;
+
+		public:
+		[[gnu::always_inline]] explicit ScopedRegion(Section &section)
+		  : section(section), start(Counters::read())
+		{
+		}
+
+		[[gnu::always_inline]] ~ScopedRegion()
+		{
+			section.add(Counters::read() - start);
+		}
+
+		ScopedRegion(const ScopedRegion &)            = delete;
+		ScopedRegion &operator=(const ScopedRegion &) = delete;
+	};
+} // namespace sonata::perf
@@ -0,0 +1,152 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace sonata
+{
+	/**
+	 * A fast, non-cryptographic pseudo-random number generator,
+	 * xoshiro128**, for games and simulations that want many random values
+	 * cheaply.  Each value is a handful of shifts, rotates and adds on
+	 * 32-bit words, so it costs a few cycles on Ibex, where making a call
+	 * on `EntropySource` for every value costs much more.
+	 *
+	 * Seed it once from an `EntropySource`, or from fixed values for a
+	 * repeatable sequence.  Like `EntropySource`, it holds its own state
+	 * and so lives in the compartment using it.
+	 */
+	class Prng
+	{
+		uint32_t state[4];
+
+		static constexpr uint32_t rotate_left(uint32_t value, uint32_t shift)
+		{
+			return (value << shift) | (value >> (32 - shift));
+		}
+
+		/**
+		 * Helper.  Returns the next output of splitmix64 from `seed`, which
+		 * spreads the bits of a seed across the state so that similar seeds
+		 * give unrelated sequences.
+		 */
+		static uint64_t splitmix64(uint64_t &seed)
+		{
+			uint64_t mixed = (seed += 0x9e3779b97f4a7c15U);
+			mixed          = (mixed ^ (mixed >> 30)) * 0xbf58476d1ce4e5b9U;
+			mixed          = (mixed ^ (mixed >> 27)) * 0x94d049bb133111ebU;
+			return mixed ^ (mixed >> 31);
+		}
+
+		public:
+		using ValueType = uint32_t;
+
+		/// A generator with a fixed seed, giving the same sequence each run.
+		Prng()
+		{
+			seed(0);
+		}
+
+		/**
+		 * Seed from a 64-bit value.  Every seed, including zero, gives a
+		 * valid state.
+		 */
+		void seed(uint64_t value)
+		{
+			const uint64_t Low  = splitmix64(value);
+			const uint64_t High = splitmix64(value);
+			state[0]            = static_cast<uint32_t>(Low);
+			state[1]            = static_cast<uint32_t>(Low >> 32);
+			state[2]            = static_cast<uint32_t>(High);
+			state[3]            = static_cast<uint32_t>(High >> 32);
+		}
+
+		/**
+		 * Seed from one value of `source`, such as an `EntropySource`.
+		 * Reseeding the source beforehand is left to the caller, as it may
+		 * be shared.
+		 */
+		template<typename Source>
+		void seed_from(Source &source)
+		{
+			seed(static_cast<uint64_t>(source()));
+		}
+
+		/// Returns the next 32 random bits.
+		ValueType operator()()
+		{
+			const uint32_t Result = rotate_left(state[1] * 5, 7) * 9;
+			const uint32_t Shift  = state[1] << 9;
+			state[2] ^= state[0];
+			state[3] ^= state[1];
+			state[1] ^= state[2];
+			state[0] ^= state[3];
+			state[2] ^= Shift;
+			state[3] = rotate_left(state[3], 11);
+			return Result;
+		}
+
+		/**
+		 * Returns a value uniformly distributed in [0, `bound`), or zero if
+		 * `bound` is zero.  This uses Lemire's multiply-shift method: the
+		 * value is the top half of the 64-bit product of a random word and
+		 * `bound`, and the few products that would bias it are rejected.
+		 * Telling those apart needs `2^32 % bound`, but only when the low
+		 * half of the product is below `bound`, so the division is almost
+		 * never made.
+		 */
+		uint32_t below(uint32_t bound)
+		{
+			uint64_t product = static_cast<uint64_t>((*this)()) * bound;
+			uint32_t low     = static_cast<uint32_t>(product);
+			if (low < bound)
+			{
+				const uint32_t Threshold = (0U - bound) % bound;
+				while (low < Threshold)
+				{
+					product = static_cast<uint64_t>((*this)()) * bound;
+					low     = static_cast<uint32_t>(product);
+				}
+			}
+			return static_cast<uint32_t>(product >> 32);
+		}
+
+		/// Returns a value uniformly distributed in [`low`, `high`].
+		int32_t between(int32_t low, int32_t high)
+		{
+			const uint32_t Span =
+			  static_cast<uint32_t>(high) - static_cast<uint32_t>(low) + 1;
+			// A span of zero is the whole range of 32-bit values.
+			const uint32_t Offset = Span == 0 ? (*this)() : below(Span);
+			return static_cast<int32_t>(static_cast<uint32_t>(low) + Offset);
+		}
+
+		/// Fills `count` words at `words` with random values.
+		void fill(uint32_t *words, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				words[i] = (*this)();
+			}
+		}
+
+		/// Fills `length` bytes at `buffer` with random values.
+		void fill(uint8_t *buffer, size_t length)
+		{
+			size_t done = 0;
+			for (; done + sizeof(uint32_t) <= length; done += sizeof(uint32_t))
+			{
+				const uint32_t Word = (*this)();
+				memcpy(buffer + done, &Word, sizeof(Word));
+			}
+			if (done < length)
+			{
+				const uint32_t Word = (*this)();
+				memcpy(buffer + done, &Word, length - done);
+			}
+		}
+	};
+} // namespace sonata
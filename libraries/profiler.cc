@@ -0,0 +1,159 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "profiler.hh"
+#include <algorithm>
+#include <futex.h>
+#include <locks.hh>
+#include <platform-uart.hh>
+#include <thread.h>
+
+#include "format.hh"
+#include "uart_write.hh"
+
+/// The samples kept before they are written out.
+static constexpr size_t MaxSamples = 256;
+
+/// The innermost calls kept in each sample.
+static constexpr size_t SampleDepth = 8;
+
+/// One sample: a thread, or zero if unattributed, and its innermost calls.
+struct Sample
+{
+	uint8_t   thread;
+	/// The number of calls in `frames`, outermost first.
+	uint8_t   depth;
+	/// Set if calls outside `frames` were left out.
+	bool      truncated;
+	ptraddr_t frames[SampleDepth];
+};
+
+static Sample   samples[MaxSamples];
+static size_t   sampleCount;
+/**
+ * Count of ticks not sampled because the samples were full or being
+ * written out.
+ */
+static uint32_t skipped;
+/// Set when the samples are full, waking `profiler_write`.
+static uint32_t samplesFull;
+/// The value of `ProfilerState::events` at the last sample.
+static uint32_t lastEvents;
+/// Held while taking a sample or writing the samples out.
+static FlagLock samplesLock;
+
+/**
+ * Helper.  Writes out the samples and forgets them.  Called with
+ * `samplesLock` held.  Returns the number of samples written.
+ */
+static int write_samples()
+{
+	auto uart = MMIO_CAPABILITY(OpenTitanUart, uart);
+	char line[48];
+	sonata::format::format_to(line,
+	                          "profile: begin hz={} samples={}\n",
+	                          static_cast<uint32_t>(TICK_RATE_HZ),
+	                          sampleCount);
+	sonata::uart_write(uart, line);
+	for (size_t i = 0; i < sampleCount; i++)
+	{
+		const Sample &sample = samples[i];
+		sonata::format::format_to(line,
+		                          "profile: {}{}",
+		                          sample.thread,
+		                          sample.truncated ? " ..." : "");
+		sonata::uart_write(uart, line);
+		for (size_t frame = 0; frame < sample.depth; frame++)
+		{
+			sonata::format::format_to(
+			  line, " {}", sonata::format::Hex{sample.frames[frame], 8});
+			sonata::uart_write(uart, line);
+		}
+		uart->blocking_write('\n');
+	}
+	sonata::format::format_to(line, "profile: end skipped={}\n", skipped);
+	sonata::uart_write(uart, line);
+
+	const int Written = static_cast<int>(sampleCount);
+	sampleCount       = 0;
+	skipped           = 0;
+	samplesFull       = 0;
+	return Written;
+}
+
+/**
+ * Helper.  Records the call stack of the thread that last ran instrumented
+ * code, or an unattributed sample if none has since the last one.
+ */
+static void take_sample()
+{
+	ProfilerState *state  = profiler_state();
+	Sample        &sample = samples[sampleCount++];
+	const uint32_t Events = state->events;
+	const uint32_t Thread = state->lastThread;
+	sample                = {};
+	if (Events == lastEvents || Thread == 0 || Thread > ProfilerMaxThreads)
+	{
+		lastEvents = Events;
+		return;
+	}
+	lastEvents = Events;
+
+	const uint32_t Depth =
+	  std::min<uint32_t>(state->depth[Thread - 1], ProfilerMaxDepth);
+	const uint32_t Kept = std::min<uint32_t>(Depth, SampleDepth);
+	sample.thread       = static_cast<uint8_t>(Thread);
+	sample.depth        = static_cast<uint8_t>(Kept);
+	sample.truncated    = state->depth[Thread - 1] > Kept;
+	for (uint32_t i = 0; i < Kept; i++)
+	{
+		sample.frames[i] = state->frames[Thread - 1][Depth - Kept + i];
+	}
+}
+
+void profiler_run()
+{
+	while (true)
+	{
+		// Wakes on the next timer tick, having preempted whichever thread
+		// was running.
+		Timeout tick{1};
+		thread_sleep(&tick);
+
+		// Writing the samples out takes seconds, so it is left to a
+		// low-priority thread rather than done here.
+		Timeout noWait{0};
+		if (LockGuard guard{samplesLock, &noWait};
+		    guard && sampleCount < MaxSamples)
+		{
+			take_sample();
+			if (sampleCount == MaxSamples)
+			{
+				samplesFull = 1;
+				futex_wake(&samplesFull, 1);
+			}
+		}
+		else
+		{
+			skipped++;
+		}
+	}
+}
+
+int profiler_dump()
+{
+	LockGuard guard{samplesLock};
+	return write_samples();
+}
+
+void profiler_write()
+{
+	while (true)
+	{
+		futex_wait(&samplesFull, 0);
+		if (samplesFull != 0)
+		{
+			profiler_dump();
+		}
+	}
+}
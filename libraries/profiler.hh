@@ -0,0 +1,87 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <compartment.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The interface of the `profiler` compartment, a sampling profiler for
+ * finding where CPU time goes across threads and compartments.
+ *
+ * The interrupted program counter belongs to the scheduler, which handles
+ * the timer interrupt, so it isn't sampled directly.  Instead, compartments
+ * built with the `profile` option have every function instrumented to keep
+ * a shadow call stack for each thread in the `profiler_state` shared
+ * object, and to note which thread ran last.  The profiler's thread, which
+ * should have the highest priority, wakes on each timer tick and records
+ * the call stack of the thread that was running when the tick preempted it.
+ * A tick in which no instrumented function was entered or left is recorded
+ * as unattributed: every thread was waiting or running uninstrumented code,
+ * or a thread was running instrumented code without calling or returning,
+ * as in a tight loop.
+ *
+ * When the buffer fills, sampling stops, and the ticks missed are counted,
+ * until the samples are written out on the UART by `profiler_dump`.  A
+ * low-priority thread running `profiler_write` calls it whenever the buffer
+ * fills, so that writing doesn't hold up the threads being profiled.  The
+ * samples are for `scripts/profile_report.py` to turn into a flat profile
+ * and a flame graph.
+ */
+
+/// Threads with IDs from one to this have a shadow stack.
+static constexpr size_t ProfilerMaxThreads = 8;
+
+/// The deepest calls kept on each shadow stack; deeper calls are counted.
+static constexpr size_t ProfilerMaxDepth = 16;
+
+/**
+ * The `profiler_state` shared object, written by the instrumentation of
+ * each profiled compartment and read by the profiler.
+ */
+struct ProfilerState
+{
+	/// The ID of the thread that last entered or left a function.
+	uint32_t  lastThread;
+	/// Count of functions entered and left, by all threads.
+	uint32_t  events;
+	/// The depth of each thread's calls.
+	uint32_t  depth[ProfilerMaxThreads];
+	/// The address of each function on each thread's shadow stack.
+	ptraddr_t frames[ProfilerMaxThreads][ProfilerMaxDepth];
+};
+
+/// The size of `profiler_state`, which firmware must give it.
+static constexpr size_t ProfilerStateSize = 552;
+static_assert(sizeof(ProfilerState) == ProfilerStateSize,
+              "The profiler_state size in the firmware must be updated");
+
+/**
+ * Returns the `profiler_state` shared object.  Not instrumented, as it is
+ * called by the instrumentation.
+ */
+[[gnu::always_inline, gnu::no_instrument_function]] inline ProfilerState *
+profiler_state()
+{
+	return SHARED_OBJECT_WITH_PERMISSIONS(
+	  ProfilerState, profiler_state, true, true, false, false);
+}
+
+/**
+ * Thread entry point for the profiler, which never returns.  It should run
+ * at a higher priority than every thread profiled.
+ */
+[[noreturn]] __cheri_compartment("profiler") void profiler_run();
+
+/**
+ * Writes out the samples taken so far on the UART, and starts again.
+ * Returns the number of samples written.
+ */
+__cheri_compartment("profiler") int profiler_dump();
+
+/**
+ * Thread entry point that calls `profiler_dump` whenever the buffer of
+ * samples fills, and never returns.  It should run at a low priority.
+ */
+[[noreturn]] __cheri_compartment("profiler") void profiler_write();
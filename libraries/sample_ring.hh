@@ -0,0 +1,97 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <futex.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <timeout.h>
+
+/**
+ * A lock-free ring buffer passing samples from one producer thread to one
+ * consumer thread in the same compartment.  The producer never blocks: if
+ * the ring is full, the sample is dropped and counted.  The consumer can
+ * block in `wait` until a sample arrives, and the producer only makes a
+ * futex call when the consumer is actually waiting.
+ *
+ * `Capacity` must be a power of two.
+ */
+template<typename T, size_t Capacity>
+class SampleRing
+{
+	static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+	              "SampleRing capacity must be a power of two");
+
+	T samples[Capacity];
+	/// Count of samples pushed, written only by the producer.
+	uint32_t head = 0;
+	/// Count of samples popped, written only by the consumer.
+	uint32_t tail = 0;
+	/// Non-zero while the consumer is, or is about to be, waiting on `head`.
+	uint32_t consumerWaiting = 0;
+	/// Count of samples dropped because the ring was full.
+	uint32_t dropped = 0;
+
+	public:
+	/**
+	 * Add a sample.  Called only by the producer.  Returns false, dropping
+	 * the sample, if the ring is full.
+	 */
+	bool push(const T &sample)
+	{
+		const uint32_t Head = head;
+		if (Head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == Capacity)
+		{
+			__atomic_store_n(&dropped, dropped + 1, __ATOMIC_RELAXED);
+			return false;
+		}
+		samples[Head % Capacity] = sample;
+		__atomic_store_n(&head, Head + 1, __ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&consumerWaiting, __ATOMIC_SEQ_CST) != 0)
+		{
+			futex_wake(&head, 1);
+		}
+		return true;
+	}
+
+	/**
+	 * Remove the oldest sample into `sample`.  Called only by the consumer.
+	 * Returns false if the ring is empty.
+	 */
+	bool pop(T &sample)
+	{
+		const uint32_t Tail = tail;
+		if (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == Tail)
+		{
+			return false;
+		}
+		sample = samples[Tail % Capacity];
+		__atomic_store_n(&tail, Tail + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	/**
+	 * Block until there is a sample to pop, or the timeout expires.  Called
+	 * only by the consumer.  Returns whether a sample is available.
+	 */
+	bool wait(Timeout *timeout)
+	{
+		const uint32_t Tail = tail;
+		__atomic_store_n(&consumerWaiting, 1, __ATOMIC_SEQ_CST);
+		// Recheck after announcing the wait, so that a push between the two
+		// either is seen here or sees the flag and wakes us.
+		while (__atomic_load_n(&head, __ATOMIC_SEQ_CST) == Tail &&
+		       timeout->may_block())
+		{
+			futex_timed_wait(timeout, &head, Tail);
+		}
+		__atomic_store_n(&consumerWaiting, 0, __ATOMIC_RELAXED);
+		return __atomic_load_n(&head, __ATOMIC_ACQUIRE) != Tail;
+	}
+
+	/// Returns the number of samples dropped because the ring was full.
+	uint32_t dropped_count()
+	{
+		return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+	}
+};
@@ -0,0 +1,103 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "spi_flash.hh"
+#include <platform-gpio.hh>
+
+using namespace sonata::flash;
+
+/**
+ * Helper.  Returns a pointer to the GPIO device.
+ */
+[[nodiscard, gnu::always_inline]] static volatile SonataGPIO *gpio()
+{
+	return MMIO_CAPABILITY(SonataGPIO, gpio);
+}
+
+/// The GPIO output driving the flash's (active low) chip select.
+static constexpr uint32_t FlashCsPin = 12;
+
+/// How the flash's SPI bus is driven: mode 0, MSB first, at full speed.
+static constexpr SpiProfile FlashSpiProfile = {.clockPolarity   = false,
+                                               .clockPhase      = false,
+                                               .msbFirst        = true,
+                                               .halfClockPeriod = 0};
+
+static constexpr uint8_t CommandReadJedecId = 0x9f;
+static constexpr uint8_t CommandReadData    = 0x03;
+
+/**
+ * Helper.  Drives the flash's chip select.
+ */
+static void set_chip_select(bool selected)
+{
+	uint32_t output = gpio()->output;
+	output &= ~(1 << FlashCsPin);
+	output |= (selected ? 0 : 1) << FlashCsPin;
+	gpio()->output = output;
+}
+
+/**
+ * Helper.  Acquires the bus for `device` and selects the flash.
+ */
+static void begin_transaction(SpiDevice *device)
+{
+	Timeout timeout{UnlimitedTimeout};
+	spi_acquire(device, &timeout);
+	set_chip_select(true);
+}
+
+/**
+ * Helper.  Deselects the flash and releases the bus.  The manager's reads
+ * and writes only return once the bus is idle, so this is safe straight
+ * after a transfer.
+ */
+static void end_transaction(SpiDevice *device)
+{
+	set_chip_select(false);
+	spi_release(device);
+}
+
+void __cheri_libcall SpiFlash::init()
+{
+	set_chip_select(false);
+	device = spi_device_open(SpiBus::Spi0, FlashSpiProfile);
+}
+
+uint32_t __cheri_libcall SpiFlash::jedec_id()
+{
+	end_read();
+	uint8_t id[3];
+	begin_transaction(device);
+	spi_write(device, &CommandReadJedecId, 1);
+	spi_read(device, id, sizeof(id));
+	end_transaction(device);
+	return (id[0] << 16) | (id[1] << 8) | id[2];
+}
+
+void __cheri_libcall SpiFlash::read(uint32_t address,
+                                    uint8_t *buffer,
+                                    size_t   length)
+{
+	if (nextAddress != address)
+	{
+		end_read();
+		const uint8_t Command[] = {CommandReadData,
+		                           static_cast<uint8_t>(address >> 16),
+		                           static_cast<uint8_t>(address >> 8),
+		                           static_cast<uint8_t>(address)};
+		begin_transaction(device);
+		spi_write(device, Command, sizeof(Command));
+	}
+	spi_read(device, buffer, length);
+	nextAddress = address + length;
+}
+
+void __cheri_libcall SpiFlash::end_read()
+{
+	if (nextAddress.has_value())
+	{
+		end_transaction(device);
+		nextAddress.reset();
+	}
+}
@@ -0,0 +1,62 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include "spi_manager.hh"
+#include <cdefs.h>
+#include <optional>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sonata::flash
+{
+	/**
+	 * The SPI flash on `spi0`.  Reads are made with the standard read
+	 * command, and a read can be left open so that sequential reads continue
+	 * without re-sending the command and address.  The bus is held, through
+	 * the `spi_manager` compartment, for as long as a read is open.
+	 */
+	class SpiFlash
+	{
+		/// The flash's handle from the SPI manager.
+		SpiDevice              *device;
+		/// The address the open read will return next, if a read is open.
+		std::optional<uint32_t> nextAddress;
+
+		void __cheri_libcall init();
+
+		public:
+		SpiFlash()
+		{
+			init();
+		}
+
+		SpiFlash(const SpiFlash &)            = delete;
+		SpiFlash &operator=(const SpiFlash &) = delete;
+
+		~SpiFlash()
+		{
+			end_read();
+			spi_device_close(device);
+		}
+
+		/**
+		 * Returns the flash's JEDEC manufacturer and device ID, packed as
+		 * 0xMMTTCC (manufacturer, memory type, capacity).
+		 */
+		uint32_t __cheri_libcall jedec_id();
+
+		/**
+		 * Read `length` bytes from `address`.  If this follows on from the
+		 * previous read, the open read command simply continues.
+		 */
+		void __cheri_libcall read(uint32_t address,
+		                          uint8_t *buffer,
+		                          size_t   length);
+
+		/**
+		 * Finish any open read, releasing the flash's chip select.
+		 */
+		void __cheri_libcall end_read();
+	};
+} // namespace sonata::flash
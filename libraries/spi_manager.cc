@@ -0,0 +1,221 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "spi_manager.hh"
+#include <algorithm>
+#include <cheri.hh>
+#include <errno.h>
+#include <locks.hh>
+#include <optional>
+#include <platform-spi.hh>
+#include <thread.h>
+#include <timeout.hh>
+#include <token.h>
+
+/**
+ * The state behind a device handle: the bus the device is on and how the
+ * controller must be driven to talk to it.
+ */
+struct SpiDevice
+{
+	SpiBus     bus;
+	SpiProfile profile;
+};
+
+/// The number of SPI controllers owned by the manager.
+static constexpr size_t BusCount = 2;
+
+/// The arbitration state of one bus.
+struct BusState
+{
+	/// Held for the duration of a client's transaction.
+	FlagLockPriorityInherited lock;
+	/// The thread holding `lock`, or zero if it is free.
+	uint16_t                  owner;
+	/// The device the bus is held for, if it is held.
+	SpiDevice                *device;
+	/// The profile the controller is currently configured with.
+	std::optional<SpiProfile> applied;
+};
+
+static BusState buses[BusCount];
+
+/**
+ * Get a token key for use sealing SpiDevices.
+ */
+static auto key()
+{
+	static auto key = token_key_new();
+	return key;
+}
+
+/**
+ * Helper.  Returns a pointer to the controller driving `bus`.
+ */
+[[nodiscard]] static volatile SonataSpi *controller(SpiBus bus)
+{
+	if (bus == SpiBus::Spi0)
+	{
+		return MMIO_CAPABILITY(SonataSpi, spi0);
+	}
+	return MMIO_CAPABILITY(SonataSpi, spi1);
+}
+
+/**
+ * Unseal a handle with our device token key.
+ */
+static SpiDevice *unseal_device(SpiDevice *device)
+{
+	return token_unseal(key(), Sealed<SpiDevice>{device});
+}
+
+/**
+ * Helper.  Unseals `device` and returns it if the calling thread holds its
+ * bus for it, or nullptr otherwise.
+ */
+static SpiDevice *held_device(SpiDevice *device)
+{
+	auto *unsealed = unseal_device(device);
+	if (unsealed == nullptr)
+	{
+		return nullptr;
+	}
+	BusState &state = buses[static_cast<size_t>(unsealed->bus)];
+	if (state.owner != thread_id_get() || state.device != unsealed)
+	{
+		return nullptr;
+	}
+	return unsealed;
+}
+
+/**
+ * Helper.  Returns the error for a call on `device` that
+ * `held_device` rejected.
+ */
+static int rejection(SpiDevice *device)
+{
+	return unseal_device(device) == nullptr ? -EINVAL : -EPERM;
+}
+
+SpiDevice *spi_device_open(SpiBus bus, SpiProfile profile)
+{
+	if (static_cast<size_t>(bus) >= BusCount)
+	{
+		return nullptr;
+	}
+
+	auto [unsealed, sealed] =
+	  blocking_forever<token_allocate<SpiDevice>>(MALLOC_CAPABILITY, key());
+	if (sealed == nullptr)
+	{
+		return nullptr;
+	}
+	unsealed->bus     = bus;
+	unsealed->profile = profile;
+	return sealed.get();
+}
+
+int spi_device_close(SpiDevice *device)
+{
+	if (held_device(device) != nullptr)
+	{
+		spi_release(device);
+	}
+	// The allocator checks validity before destroying so we don't have to.
+	return token_obj_destroy(
+	  MALLOC_CAPABILITY, key(), reinterpret_cast<SObj>(device));
+}
+
+int spi_acquire(SpiDevice *device, Timeout *timeout)
+{
+	auto *unsealed = unseal_device(device);
+	if (unsealed == nullptr)
+	{
+		return -EINVAL;
+	}
+	BusState      &state = buses[static_cast<size_t>(unsealed->bus)];
+	const uint16_t Self  = thread_id_get();
+	if (state.owner != Self)
+	{
+		if (!state.lock.try_lock(timeout))
+		{
+			return -ETIMEDOUT;
+		}
+		state.owner = Self;
+	}
+	state.device = unsealed;
+
+	// Only reconfigure the controller when the profile changes, so that
+	// back-to-back transactions with one device pay nothing for it.
+	if (state.applied != unsealed->profile)
+	{
+		const SpiProfile &Profile = unsealed->profile;
+		controller(unsealed->bus)->wait_idle();
+		controller(unsealed->bus)->init(Profile.clockPolarity,
+		                                Profile.clockPhase,
+		                                Profile.msbFirst,
+		                                Profile.halfClockPeriod);
+		state.applied = Profile;
+	}
+	return 0;
+}
+
+int spi_release(SpiDevice *device)
+{
+	auto *unsealed = held_device(device);
+	if (unsealed == nullptr)
+	{
+		return rejection(device);
+	}
+	BusState &state = buses[static_cast<size_t>(unsealed->bus)];
+	controller(unsealed->bus)->wait_idle();
+	state.device = nullptr;
+	state.owner  = 0;
+	state.lock.unlock();
+	return 0;
+}
+
+/// The driver transfers at most this many bytes at a time.
+static constexpr size_t MaxTransfer = UINT16_MAX;
+
+int spi_write(SpiDevice *device, const uint8_t *data, size_t length)
+{
+	auto *unsealed = held_device(device);
+	if (unsealed == nullptr)
+	{
+		return rejection(device);
+	}
+	if (!CHERI::check_pointer(data, length))
+	{
+		return -EINVAL;
+	}
+	auto spi = controller(unsealed->bus);
+	for (size_t done = 0; done < length; done += MaxTransfer)
+	{
+		spi->blocking_write(data + done, std::min(length - done, MaxTransfer));
+	}
+	// Clients change chip select and other control lines straight after a
+	// write, so it must have left the controller.
+	spi->wait_idle();
+	return 0;
+}
+
+int spi_read(SpiDevice *device, uint8_t *buffer, size_t length)
+{
+	auto *unsealed = held_device(device);
+	if (unsealed == nullptr)
+	{
+		return rejection(device);
+	}
+	if (!CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Store}>(
+	      buffer, length))
+	{
+		return -EINVAL;
+	}
+	auto spi = controller(unsealed->bus);
+	for (size_t done = 0; done < length; done += MaxTransfer)
+	{
+		spi->blocking_read(buffer + done, std::min(length - done, MaxTransfer));
+	}
+	return 0;
+}
@@ -0,0 +1,83 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <compartment.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <timeout.h>
+
+/// The SPI controllers owned by the `spi_manager` compartment.
+enum class SpiBus : uint8_t
+{
+	/// `spi0`, wired to the SPI flash.
+	Spi0,
+	/// `spi1`, wired to the LCD.
+	Spi1,
+};
+
+/**
+ * How a device expects the bus to be driven.  The arguments of
+ * `SonataSpi::init`, kept so that the manager can tell whether the
+ * controller must be reconfigured when the bus passes between devices.
+ */
+struct SpiProfile
+{
+	bool     clockPolarity;
+	bool     clockPhase;
+	bool     msbFirst;
+	/// The half period of the SPI clock, in system clock cycles, minus one.
+	uint16_t halfClockPeriod;
+
+	bool operator==(const SpiProfile &) const = default;
+};
+
+/**
+ * A sealed handle to a device on one of the SPI buses, holding its profile.
+ * Only the `spi_manager` compartment can unseal it.
+ */
+struct SpiDevice;
+
+/**
+ * The interface of the `spi_manager` compartment, which owns the SPI
+ * controllers.  A client opens a device, then brackets each transaction
+ * (normally while it holds the device's chip select) between
+ * `spi_acquire` and `spi_release`.  Acquiring locks the bus, with priority
+ * inheritance so that a low-priority holder is boosted while a
+ * higher-priority thread waits, and reconfigures the controller only if the
+ * device's profile differs from the one last applied.  Chip selects are
+ * GPIO outputs driven by the clients, which must only assert them while
+ * holding the bus.
+ *
+ * Calls return zero on success, `-EINVAL` if the handle or a buffer is not
+ * valid, or `-EPERM` if the calling thread does not hold the bus for this
+ * device.
+ */
+
+/**
+ * Opens a device on `bus`, driven with `profile`.  Returns nullptr if the
+ * bus is not valid or the handle can't be allocated.
+ */
+__cheri_compartment("spi_manager") SpiDevice *spi_device_open(
+  SpiBus     bus,
+  SpiProfile profile);
+/// Closes a device, releasing the bus first if it is held for it.
+__cheri_compartment("spi_manager") int spi_device_close(SpiDevice *);
+/**
+ * Locks the device's bus for the calling thread, waiting at most `timeout`
+ * for the current holder to release it, and applies the device's profile.
+ * Acquiring a bus the thread already holds just switches to this device.
+ * Returns `-ETIMEDOUT` if the bus could not be locked in time.
+ */
+__cheri_compartment("spi_manager") int spi_acquire(SpiDevice *,
+                                                   Timeout *timeout);
+/// Waits for the bus to go idle, then unlocks it.
+__cheri_compartment("spi_manager") int spi_release(SpiDevice *);
+/// Writes `length` bytes, returning once they have all been sent.
+__cheri_compartment("spi_manager") int spi_write(SpiDevice *,
+                                                 const uint8_t *data,
+                                                 size_t         length);
+/// Reads `length` bytes into `buffer`.
+__cheri_compartment("spi_manager") int spi_read(SpiDevice *,
+                                                uint8_t *buffer,
+                                                size_t   length);
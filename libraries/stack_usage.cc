@@ -0,0 +1,45 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "stack_usage.hh"
+#include <thread.h>
+
+#include "async_log.hh"
+
+/// Seconds between reports.
+static constexpr uint32_t ReportSeconds = 10;
+
+void stack_usage_report()
+{
+	const StackUsageState *state = stack_usage_state();
+	uint32_t               size[StackUsageMaxThreads];
+	uint32_t               headroom[StackUsageMaxThreads];
+	while (true)
+	{
+		Timeout wait{ReportSeconds * TICK_RATE_HZ};
+		thread_sleep(&wait);
+
+		// Take every depth at once, then hand the lines to the async_log
+		// drain, giving up on those it can't take within a second.
+		for (size_t i = 0; i < StackUsageMaxThreads; i++)
+		{
+			size[i]     = state->size[i];
+			headroom[i] = state->headroom[i];
+		}
+		Timeout budget{TICK_RATE_HZ};
+		for (uint16_t id = 1; id <= StackUsageMaxThreads; id++)
+		{
+			if (size[id - 1] == 0)
+			{
+				continue;
+			}
+			sonata::async_log_wait(
+			  &budget,
+			  "stack_usage: thread={} size={} used={} headroom={}",
+			  id,
+			  size[id - 1],
+			  size[id - 1] - headroom[id - 1],
+			  headroom[id - 1]);
+		}
+	}
+}
@@ -0,0 +1,69 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <compartment.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The interface of the `stack_usage` compartment, which measures how deep
+ * each thread's stack has grown, so that the stack sizes in the firmware
+ * definitions can be set from measurements.
+ *
+ * Painting stacks with a pattern doesn't work here: the switcher zeroes
+ * the part of a stack that a compartment call used when it returns, and
+ * the part below the caller's frame before each call, which erases both
+ * the pattern and any trace of how deep the callee went.  Instead,
+ * compartments built with the `stack-usage` option have every function
+ * instrumented to note the stack pointer on entry, and each thread's
+ * lowest is kept in the `stack_usage_state` shared object.  The stack
+ * used by uninstrumented code, such as the RTOS's compartments and
+ * libraries, isn't seen, so measurements need a margin.
+ *
+ * A thread running `stack_usage_report` logs each thread's stack size
+ * and the most it has used through `async_log`, every ten seconds, for
+ * `scripts/stack_report.py` to check against the firmware definitions.
+ */
+
+/// Threads with IDs from one to this are measured.
+static constexpr size_t StackUsageMaxThreads = 8;
+
+/**
+ * The `stack_usage_state` shared object, written by the instrumentation of
+ * each measured compartment and read by the reporter.
+ */
+struct StackUsageState
+{
+	/**
+	 * The size of each thread's stack, or zero if none of its functions
+	 * have been instrumented yet.
+	 */
+	uint32_t size[StackUsageMaxThreads];
+	/// The least each thread's stack has had free, in bytes.
+	uint32_t headroom[StackUsageMaxThreads];
+};
+
+/// The size of `stack_usage_state`, which firmware must give it.
+static constexpr size_t StackUsageStateSize = 64;
+static_assert(sizeof(StackUsageState) == StackUsageStateSize,
+              "The stack_usage_state size in the firmware must be updated");
+
+/**
+ * Returns the `stack_usage_state` shared object.  Not instrumented, as it is
+ * called by the instrumentation.
+ */
+[[gnu::always_inline, gnu::no_instrument_function]] inline StackUsageState *
+stack_usage_state()
+{
+	return SHARED_OBJECT_WITH_PERMISSIONS(
+	  StackUsageState, stack_usage_state, true, true, false, false);
+}
+
+/**
+ * Thread entry point that logs the stack usage every ten seconds, and
+ * never returns.  It should run at a high priority, so that it isn't
+ * starved by the threads it measures, and the firmware must run the
+ * `async_log` drain.
+ */
+[[noreturn]] __cheri_compartment("stack_usage") void stack_usage_report();
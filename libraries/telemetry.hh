@@ -0,0 +1,259 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <errno.h>
+#include <riscvreg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+#include "async_log.hh"
+
+/**
+ * A binary telemetry channel over the UART, for getting samples, frame
+ * times and counters off the board faster than they could be logged as
+ * text.  Each value published on a channel is sent as one frame through
+ * the `async_log` compartment, so publishing never waits on the UART.
+ *
+ * A frame's payload is its kind, the rest of a header, the values and a
+ * CRC-16/CCITT of them all, encoded with COBS so that it contains no zero
+ * bytes and delimited by a zero byte on each side.  Text doesn't contain
+ * zero bytes, and the records sent by `sonata::log` in the `tokenised-log`
+ * build, which do, are sent as frames of their own kind.  So
+ * `scripts/telemetry_collector.py` can tell frames and text apart, and skip
+ * the frames that `scripts/token_log_decoder.py` reads, and both
+ * resynchronise at the next zero if they start reading or lose bytes
+ * part-way through a frame.
+ *
+ * Channels are numbered by their owners, and numbers must be unique within
+ * a firmware image.  Every `DescribeInterval` samples a channel also sends
+ * a description giving its name and value type, so that a collector
+ * started at any time learns what the channel holds.
+ */
+namespace sonata::telemetry
+{
+	/// The kinds of frame.
+	enum class FrameKind : uint8_t
+	{
+		/// A channel's name, value type and field count, and the clock rate.
+		Describe = 1,
+		/// A sample of a channel's values.
+		Sample = 2,
+		/// A record from `sonata::log` in the `tokenised-log` build.
+		LogRecord = 3,
+	};
+
+	/// The types of value a channel can carry.
+	enum class ValueType : uint8_t
+	{
+		U8,
+		I8,
+		U16,
+		I16,
+		U32,
+		I32,
+		U64,
+		I64,
+		F32,
+	};
+
+	/// Returns the `ValueType` for `T`.
+	template<typename T>
+	consteval ValueType value_type()
+	{
+		if constexpr (std::is_same_v<T, float>)
+		{
+			return ValueType::F32;
+		}
+		else
+		{
+			static_assert(std::is_integral_v<T> && sizeof(T) <= 8,
+			              "Channels carry integers or floats");
+			constexpr bool Signed = std::is_signed_v<T>;
+			switch (sizeof(T))
+			{
+				case 1:
+					return Signed ? ValueType::I8 : ValueType::U8;
+				case 2:
+					return Signed ? ValueType::I16 : ValueType::U16;
+				case 4:
+					return Signed ? ValueType::I32 : ValueType::U32;
+				default:
+					return Signed ? ValueType::I64 : ValueType::U64;
+			}
+		}
+	}
+
+	/// The longest payload, header and CRC included, that fits in a frame.
+	static constexpr size_t MaxPayload = AsyncLogMaxLine - 3;
+
+	/// The size of the header at the start of every frame.
+	static constexpr size_t HeaderSize = 12;
+
+	/// Samples between the descriptions sent by each channel.
+	static constexpr uint16_t DescribeInterval = 64;
+
+	/// The longest channel name sent.
+	static constexpr size_t MaxName = MaxPayload - HeaderSize - 2 - 6;
+
+	/**
+	 * Returns the CRC-16/CCITT (polynomial 0x1021, initial value 0xffff) of
+	 * `length` bytes at `data`, a nibble at a time.
+	 */
+	inline uint16_t crc16(const uint8_t *data, size_t length)
+	{
+		static constexpr uint16_t Table[16] = {
+		  0x0000,
+		  0x1021,
+		  0x2042,
+		  0x3063,
+		  0x4084,
+		  0x50a5,
+		  0x60c6,
+		  0x70e7,
+		  0x8108,
+		  0x9129,
+		  0xa14a,
+		  0xb16b,
+		  0xc18c,
+		  0xd1ad,
+		  0xe1ce,
+		  0xf1ef,
+		};
+		uint16_t crc = 0xffff;
+		for (size_t i = 0; i < length; i++)
+		{
+			crc = static_cast<uint16_t>((crc << 4) ^
+			                            Table[(crc >> 12) ^ (data[i] >> 4)]);
+			crc = static_cast<uint16_t>((crc << 4) ^
+			                            Table[(crc >> 12) ^ (data[i] & 0xf)]);
+		}
+		return crc;
+	}
+
+	/**
+	 * COBS-encodes `length` bytes at `data` into `frame`, between two zero
+	 * delimiters.  `frame` must have room for `length + 3` bytes, plus one
+	 * for every 254 bytes of data.  Returns the length of the frame.
+	 */
+	inline size_t cobs_frame(const uint8_t *data, size_t length, uint8_t *frame)
+	{
+		frame[0]       = 0;
+		size_t  codeAt = 1;
+		size_t  out    = 2;
+		uint8_t code   = 1;
+		for (size_t i = 0; i < length; i++)
+		{
+			if (data[i] != 0)
+			{
+				frame[out++] = data[i];
+				code++;
+			}
+			if (data[i] == 0 || code == 0xff)
+			{
+				frame[codeAt] = code;
+				codeAt        = out++;
+				code          = 1;
+			}
+		}
+		frame[codeAt] = code;
+		frame[out++]  = 0;
+		return out;
+	}
+
+	/**
+	 * Helper.  Adds a CRC to the first `length` bytes of `payload`, which
+	 * must have room for two more, then frames and queues it.  Returns as
+	 * `async_log_write_record`.
+	 */
+	inline int send_payload(uint8_t *payload, size_t length)
+	{
+		const uint16_t Crc = crc16(payload, length);
+		payload[length++]  = static_cast<uint8_t>(Crc);
+		payload[length++]  = static_cast<uint8_t>(Crc >> 8);
+		uint8_t frame[AsyncLogMaxLine];
+		return async_log_write_record(frame,
+		                              cobs_frame(payload, length, frame));
+	}
+
+	/**
+	 * A channel of samples, each of `Fields` values of type `T`, identified
+	 * on the wire by `id` and named `name` in the collector's output.
+	 */
+	template<typename T, size_t Fields = 1>
+	class Channel
+	{
+		static_assert(HeaderSize + Fields * sizeof(T) + 2 <= MaxPayload,
+		              "A sample must fit in one frame");
+
+		uint8_t     id;
+		const char *name;
+		uint16_t    sequence = 0;
+
+		/**
+		 * Helper.  Writes a frame header for `kind` to `payload`, stamped
+		 * with the cycle count, and returns its size.
+		 */
+		size_t put_header(uint8_t *payload, FrameKind kind)
+		{
+			const uint64_t Now = rdcycle64();
+			payload[0]         = static_cast<uint8_t>(kind);
+			payload[1]         = id;
+			memcpy(payload + 2, &sequence, sizeof(sequence));
+			memcpy(payload + 4, &Now, sizeof(Now));
+			return HeaderSize;
+		}
+
+		public:
+		Channel(uint8_t id, const char *name) : id(id), name(name) {}
+
+		/**
+		 * Sends the channel's name, value type and field count, and the
+		 * rate of the cycle counter used for timestamps.  Sent
+		 * automatically every `DescribeInterval` samples.
+		 */
+		int describe()
+		{
+			uint8_t        payload[MaxPayload];
+			size_t         length = put_header(payload, FrameKind::Describe);
+			const uint32_t Hz     = CPU_TIMER_HZ;
+			payload[length++]     = static_cast<uint8_t>(value_type<T>());
+			payload[length++]     = static_cast<uint8_t>(Fields);
+			memcpy(payload + length, &Hz, sizeof(Hz));
+			length += sizeof(Hz);
+			const size_t NameLength = strnlen(name, MaxName);
+			memcpy(payload + length, name, NameLength);
+			length += NameLength;
+			return send_payload(payload, length);
+		}
+
+		/**
+		 * Publishes a sample.  Returns zero, or `-ENOSPC` if the sample was
+		 * dropped because the `async_log` ring was full; the collector also
+		 * sees the gap in the sequence numbers.
+		 */
+		int publish(const T (&values)[Fields])
+		{
+			if (sequence % DescribeInterval == 0)
+			{
+				describe();
+			}
+			uint8_t payload[MaxPayload];
+			size_t  length = put_header(payload, FrameKind::Sample);
+			memcpy(payload + length, values, sizeof(values));
+			length += sizeof(values);
+			sequence++;
+			return send_payload(payload, length);
+		}
+
+		/// Publishes a sample of a single-valued channel.
+		int publish(T value)
+		  requires(Fields == 1)
+		{
+			const T Values[1] = {value};
+			return publish(Values);
+		}
+	};
+} // namespace sonata::telemetry
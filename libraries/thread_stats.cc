@@ -0,0 +1,142 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include "thread_stats.hh"
+#include <cheri.hh>
+#include <errno.h>
+#include <riscvreg.h>
+#include <thread.h>
+
+#include "async_log.hh"
+
+/**
+ * Off-CPU cycles in a checkpoint interval below which the thread is taken
+ * to have kept running, only interrupted by a timer tick.
+ */
+static constexpr uint64_t DescheduledThreshold = 2000;
+
+/// The accounting for each thread, indexed by thread ID less one.
+static ThreadStats stats[ThreadStatsMaxThreads];
+
+/// The cycle counter at each thread's last checkpoint.
+static uint64_t lastCheckpoint[ThreadStatsMaxThreads];
+
+int thread_stats_record()
+{
+	const uint16_t Thread = thread_id_get();
+	if (Thread == 0 || Thread > ThreadStatsMaxThreads)
+	{
+		return -ENOSPC;
+	}
+	ThreadStats   &thread = stats[Thread - 1];
+	const uint64_t Now    = rdcycle64();
+	const uint64_t Run    = thread_elapsed_cycles_current();
+	if (thread.checkpoints > 0)
+	{
+		const uint64_t Elapsed = Now - lastCheckpoint[Thread - 1];
+		const uint64_t Ran     = Run - thread.runCycles;
+		const uint64_t Off     = Elapsed > Ran ? Elapsed - Ran : 0;
+		thread.offCycles += Off;
+		if (Off > DescheduledThreshold)
+		{
+			thread.descheduled++;
+		}
+	}
+	thread.runCycles = Run;
+	thread.checkpoints++;
+	lastCheckpoint[Thread - 1] = Now;
+	return 0;
+}
+
+int thread_stats_get(uint16_t threadId, ThreadStats *threadStats)
+{
+	if (threadId == 0 || threadId > ThreadStatsMaxThreads ||
+	    !CHERI::check_pointer<CHERI::PermissionSet{CHERI::Permission::Store}>(
+	      threadStats))
+	{
+		return -EINVAL;
+	}
+	*threadStats = stats[threadId - 1];
+	return 0;
+}
+
+uint64_t thread_stats_idle_cycles()
+{
+	return thread_elapsed_cycles_idle();
+}
+
+/**
+ * Helper.  Returns `part` of `whole` as a percentage, to one decimal
+ * place.
+ */
+static sonata::format::Fixed percent(uint64_t part, uint64_t whole)
+{
+	const uint64_t Tenths = whole == 0 ? 0 : part * 1000 / whole;
+	// Within 1/256 of the exact value, which rounds to it.
+	return {static_cast<int64_t>(Tenths * 256 / 10), 8, 1};
+}
+
+void thread_stats_report()
+{
+	uint64_t    lastTime = rdcycle64();
+	uint64_t    lastIdle = thread_elapsed_cycles_idle();
+	uint64_t    lastRun[ThreadStatsMaxThreads] = {};
+	ThreadStats snapshot[ThreadStatsMaxThreads];
+	while (true)
+	{
+		Timeout second{TICK_RATE_HZ};
+		thread_sleep(&second);
+
+		// Take every count at once, before waiting on the log.
+		const uint64_t Now  = rdcycle64();
+		const uint64_t Idle = thread_elapsed_cycles_idle();
+		for (size_t i = 0; i < ThreadStatsMaxThreads; i++)
+		{
+			snapshot[i] = stats[i];
+		}
+
+		// The report is handed to the async_log drain, which runs at a low
+		// priority, rather than written out here and interleaved with its
+		// lines and frames.  It gives up on lines it can't log within half a
+		// second, leaving the drain to note the drop.
+		Timeout        budget{TICK_RATE_HZ / 2};
+		const uint64_t Elapsed = Now - lastTime;
+		uint64_t       counted = Idle - lastIdle;
+		sonata::async_log_wait(&budget,
+		                       "thread_stats: idle_percent={}",
+		                       percent(Idle - lastIdle, Elapsed));
+		for (uint16_t id = 1; id <= ThreadStatsMaxThreads; id++)
+		{
+			const ThreadStats &thread = snapshot[id - 1];
+			if (thread.checkpoints == 0)
+			{
+				continue;
+			}
+			const uint64_t Ran = thread.runCycles - lastRun[id - 1];
+			lastRun[id - 1]    = thread.runCycles;
+			counted += Ran;
+			// Split in two to keep each line within AsyncLogMaxLine.
+			sonata::async_log_wait(&budget,
+			                       "thread_stats: thread={} run_percent={} "
+			                       "run_cycles={} off_cycles={}",
+			                       id,
+			                       percent(Ran, Elapsed),
+			                       thread.runCycles,
+			                       thread.offCycles);
+			sonata::async_log_wait(
+			  &budget,
+			  "thread_stats: thread={} checkpoints={} descheduled={}",
+			  id,
+			  thread.checkpoints,
+			  thread.descheduled);
+		}
+		// Cycles run by threads without checkpoints, by threads since their
+		// last checkpoint, and by the scheduler.
+		sonata::async_log_wait(
+		  &budget,
+		  "thread_stats: unaccounted_percent={}",
+		  percent(Elapsed > counted ? Elapsed - counted : 0, Elapsed));
+		lastTime = Now;
+		lastIdle = Idle;
+	}
+}
@@ -0,0 +1,100 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <compartment.h>
+#include <riscvreg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <thread.h>
+
+/**
+ * The interface of the `thread_stats` compartment, which accounts for how
+ * the CPU's cycles are shared between threads and idle time, so that
+ * thread priorities can be set from measurements and busy-waiting threads
+ * found.
+ *
+ * The scheduler counts the cycles each thread runs for, and the cycles
+ * spent idle, when the RTOS is built with scheduler accounting, but a
+ * thread can only read its own count.  So each accounted thread calls
+ * `sonata::thread_stats_checkpoint` from its main loop, which records its
+ * count here, along with the cycles it spent off the CPU since its last
+ * checkpoint, whether waiting or preempted.
+ *
+ * A thread running `thread_stats_report` logs every thread's share of
+ * the cycles, and the idle share, once a second, as `key=value` pairs,
+ * through `async_log`.
+ * Threads are identified by ID, which is their position in the firmware's
+ * thread list, starting from one.
+ */
+
+/// Threads with IDs from one to this are accounted for.
+static constexpr size_t ThreadStatsMaxThreads = 8;
+
+/// The accounting for one thread.
+struct ThreadStats
+{
+	/// Cycles run, as of the thread's last checkpoint.
+	uint64_t runCycles;
+	/// Cycles spent off the CPU between checkpoints.
+	uint64_t offCycles;
+	/// Count of checkpoints.
+	uint32_t checkpoints;
+	/**
+	 * Count of checkpoint intervals in which the thread left the CPU,
+	 * to wait or because it was preempted: a lower bound on the number of
+	 * times it was woken or resumed.
+	 */
+	uint32_t descheduled;
+};
+
+/**
+ * Records the calling thread's cycle count.  Returns zero, or `-ENOSPC` if
+ * the thread isn't accounted for.  Use `sonata::thread_stats_checkpoint`,
+ * which calls this at most ten times a second.
+ */
+__cheri_compartment("thread_stats") int thread_stats_record();
+
+/**
+ * Copies the accounting for the thread with ID `threadId` to `stats`.
+ * Returns zero, or `-EINVAL` if the thread isn't accounted for or `stats`
+ * is not valid.
+ */
+__cheri_compartment("thread_stats") int thread_stats_get(uint16_t     threadId,
+                                                         ThreadStats *stats);
+
+/// Returns the cycles the CPU has spent idle.
+__cheri_compartment("thread_stats") uint64_t thread_stats_idle_cycles();
+
+/**
+ * Thread entry point that logs the accounting once a second, and never
+ * returns.  It should run at a high priority, so that it isn't starved by
+ * the threads it accounts for, and the firmware must run the `async_log`
+ * drain.
+ */
+[[noreturn]] __cheri_compartment("thread_stats") void thread_stats_report();
+
+namespace sonata
+{
+	/**
+	 * Records the calling thread's cycle count with `thread_stats_record`,
+	 * if built with `SONATA_THREAD_STATS` (the `thread-stats` build option)
+	 * and at most ten times a second, so that it can be called from any
+	 * loop.  Otherwise does nothing.
+	 */
+	inline void thread_stats_checkpoint()
+	{
+#ifdef SONATA_THREAD_STATS
+		static uint64_t lastRecord[ThreadStatsMaxThreads];
+		const uint16_t  Thread = thread_id_get();
+		const uint64_t  Now    = rdcycle64();
+		if (Thread == 0 || Thread > ThreadStatsMaxThreads ||
+		    Now - lastRecord[Thread - 1] < CPU_TIMER_HZ / 10)
+		{
+			return;
+		}
+		lastRecord[Thread - 1] = Now;
+		thread_stats_record();
+#endif
+	}
+} // namespace sonata
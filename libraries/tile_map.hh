@@ -0,0 +1,314 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+#include "lcd.hh"
+
+namespace sonata::lcd
+{
+	/**
+	 * How a `TileMap` draws one kind of tile: filled with `color` or, if
+	 * `sprite` is set, with the sprite scaled to the tile and its `key`
+	 * coloured pixels showing `color` instead.  `spans`, the sprite's
+	 * opaque spans, are only needed when drawing to a display that can't
+	 * stream images, such as `SharedLcd`.
+	 */
+	struct TileStyle
+	{
+		Color             color;
+		const Sprite     *sprite    = nullptr;
+		Color             key       = Color::Black;
+		const SpriteSpan *spans     = nullptr;
+		size_t            spanCount = 0;
+	};
+
+	/**
+	 * A grid of tiles, each holding an index into a table of styles.
+	 * Changing a tile marks it dirty, and `flush` redraws only the dirty
+	 * tiles.  Each run of adjacent dirty tiles in a row is written as one
+	 * window, with the gaps between its tiles, so a frame that changes a
+	 * handful of tiles costs a handful of window writes however the changes
+	 * were made.
+	 *
+	 * The grid may be smaller than `MaxColumns` by `MaxRows`, which only
+	 * set the storage reserved for it.  Tiles are `spacing` apart, and the
+	 * spacing is drawn in `gapColor` between tiles of a run; the map never
+	 * draws the spacing around the outside of a tile or between rows, which
+	 * is left to the background.
+	 */
+	template<size_t MaxColumns, size_t MaxRows>
+	class TileMap
+	{
+		static_assert(MaxColumns > 0 && MaxColumns <= 64,
+		              "A tile map row's dirty bits must fit in 64 bits");
+
+		using DirtyMask =
+		  std::conditional_t<(MaxColumns <= 32), uint32_t, uint64_t>;
+		static constexpr uint32_t MaskBits = sizeof(DirtyMask) * 8;
+
+		public:
+		using TileId = uint8_t;
+
+		private:
+		Size             grid;
+		Point            origin;
+		Size             tileSize;
+		Size             spacing;
+		Color            gapColor;
+		const TileStyle *styles;
+		size_t           styleCount;
+		TileId           tiles[MaxRows][MaxColumns] = {};
+		DirtyMask        dirty[MaxRows]             = {};
+
+		/**
+		 * A run of dirty tiles being streamed to the display, which is the
+		 * context passed to `read_run`.
+		 */
+		struct Run
+		{
+			const TileMap *map;
+			uint32_t       row;
+			uint32_t       firstColumn;
+			uint32_t       width;
+		};
+
+		/// Returns the style for `id`, or nullptr if there isn't one.
+		const TileStyle *style_for(TileId id) const
+		{
+			return id < styleCount ? &styles[id] : nullptr;
+		}
+
+		/**
+		 * Returns the pixel at (`x`, `y`) within a tile with `style`,
+		 * sampling a sprite in the same way as `draw_sprite_scaled`.
+		 */
+		uint16_t
+		tile_pixel(const TileStyle *style, uint32_t x, uint32_t y) const
+		{
+			if (style == nullptr)
+			{
+				return gapColor.to_rgb565();
+			}
+			if (style->sprite == nullptr)
+			{
+				return style->color.to_rgb565();
+			}
+			const Size     Source = style->sprite->size;
+			const uint32_t SourceX =
+			  (2 * x + 1) * Source.width / (2 * tileSize.width);
+			const uint32_t SourceY =
+			  (2 * y + 1) * Source.height / (2 * tileSize.height);
+			const uint8_t *pixel =
+			  style->sprite->data + 2 * (SourceY * Source.width + SourceX);
+			const uint16_t Value = pixel[0] | (pixel[1] << 8);
+			return Value == style->key.to_rgb565() ? style->color.to_rgb565()
+			                                       : Value;
+		}
+
+		/**
+		 * An `ImageReader` producing the RGB565 pixels of a run, row by
+		 * row, from the tiles' styles.
+		 */
+		static void
+		read_run(void *context, size_t offset, uint8_t *buffer, size_t length)
+		{
+			const Run     &run    = *static_cast<const Run *>(context);
+			const TileMap &map    = *run.map;
+			const uint32_t Pitch  = map.tileSize.width + map.spacing.width;
+			const size_t   First  = offset / 2;
+			uint32_t       x      = First % run.width;
+			uint32_t       y      = First / run.width;
+			uint32_t       column = run.firstColumn + x / Pitch;
+			uint32_t       inTile = x % Pitch;
+			for (size_t i = 0; i < length / 2; i++)
+			{
+				const uint16_t Pixel =
+				  inTile < map.tileSize.width
+				    ? map.tile_pixel(
+				        map.style_for(map.tiles[run.row][column]), inTile, y)
+				    : map.gapColor.to_rgb565();
+				buffer[2 * i]     = static_cast<uint8_t>(Pixel);
+				buffer[2 * i + 1] = static_cast<uint8_t>(Pixel >> 8);
+				if (++x == run.width)
+				{
+					x      = 0;
+					y      = y + 1;
+					column = run.firstColumn;
+					inTile = 0;
+				}
+				else if (++inTile == Pitch)
+				{
+					column = column + 1;
+					inTile = 0;
+				}
+			}
+		}
+
+		/**
+		 * Draw one dirty tile on its own, for displays that can't stream
+		 * images.
+		 */
+		template<typename Display>
+		void draw_tile(Display &lcd, uint32_t column, uint32_t row)
+		{
+			const Rect       TileRect = tile_rect(column, row);
+			const TileStyle *style    = style_for(tiles[row][column]);
+			if (style == nullptr)
+			{
+				lcd.fill_rect(TileRect, gapColor);
+				return;
+			}
+			lcd.fill_rect(TileRect, style->color);
+			if (style->sprite != nullptr)
+			{
+				lcd.draw_sprite_scaled(
+				  TileRect, *style->sprite, style->spans, style->spanCount);
+			}
+		}
+
+		public:
+		/**
+		 * A map of `grid` tiles, clamped to `MaxColumns` by `MaxRows`, with
+		 * its top-left tile at `origin`.  Tile IDs index `styles`, which
+		 * must outlive the map; tiles with IDs beyond `styleCount` are
+		 * drawn in `gapColor`.  Every tile starts as ID zero, and dirty.
+		 */
+		TileMap(Size             grid       = {0, 0},
+		        Point            origin     = Point::ORIGIN,
+		        Size             tileSize   = {1, 1},
+		        Size             spacing    = {0, 0},
+		        Color            gapColor   = Color::Black,
+		        const TileStyle *styles     = nullptr,
+		        size_t           styleCount = 0)
+		  : grid({std::min<uint32_t>(grid.width, MaxColumns),
+		          std::min<uint32_t>(grid.height, MaxRows)}),
+		    origin(origin),
+		    tileSize(tileSize),
+		    spacing(spacing),
+		    gapColor(gapColor),
+		    styles(styles),
+		    styleCount(styleCount)
+		{
+			invalidate();
+		}
+
+		Size size() const
+		{
+			return grid;
+		}
+
+		TileId get(uint32_t column, uint32_t row) const
+		{
+			return tiles[row][column];
+		}
+
+		/**
+		 * Set a tile, marking it dirty if its ID changes.  Positions
+		 * outside the grid are ignored.
+		 */
+		void set(uint32_t column, uint32_t row, TileId id)
+		{
+			if (column >= grid.width || row >= grid.height ||
+			    tiles[row][column] == id)
+			{
+				return;
+			}
+			tiles[row][column] = id;
+			dirty[row] |= DirtyMask{1} << column;
+		}
+
+		/// Set every tile to `id`.
+		void fill(TileId id)
+		{
+			for (uint32_t row = 0; row < grid.height; row++)
+			{
+				for (uint32_t column = 0; column < grid.width; column++)
+				{
+					set(column, row, id);
+				}
+			}
+		}
+
+		/**
+		 * Mark every tile dirty, so that the next `flush` redraws the whole
+		 * map; for use when something else has drawn over it.
+		 */
+		void invalidate()
+		{
+			const DirtyMask All = grid.width == MaskBits
+			                        ? ~DirtyMask{0}
+			                        : (DirtyMask{1} << grid.width) - 1;
+			for (uint32_t row = 0; row < grid.height; row++)
+			{
+				dirty[row] = All;
+			}
+		}
+
+		/// Returns the area of the display covered by a tile.
+		Rect tile_rect(uint32_t column, uint32_t row) const
+		{
+			return Rect::from_point_and_size(
+			  {origin.x + column * (tileSize.width + spacing.width),
+			   origin.y + row * (tileSize.height + spacing.height)},
+			  tileSize);
+		}
+
+		/**
+		 * Draw every dirty tile and mark it clean.  Returns the number of
+		 * window writes made, one per run of adjacent dirty tiles (or, for
+		 * displays that can't stream images, one per tile).
+		 */
+		template<typename Display>
+		size_t flush(Display &lcd)
+		{
+			constexpr bool CanStream = requires(Display &display,
+			                                    Rect        rect,
+			                                    ImageReader read,
+			                                    void       *context) {
+				display.draw_image_rgb565(rect, read, context);
+			};
+			size_t writes = 0;
+			for (uint32_t row = 0; row < grid.height; row++)
+			{
+				DirtyMask remaining = dirty[row];
+				dirty[row]          = 0;
+				while (remaining != 0)
+				{
+					// Find the lowest run of set bits, [First, Last), and
+					// clear it.
+					const uint32_t  First = __builtin_ctzll(remaining);
+					const DirtyMask Clean = ~(remaining >> First);
+					const uint32_t  Last  = Clean == 0
+					                          ? MaskBits
+					                          : First + __builtin_ctzll(Clean);
+					remaining =
+					  Last == MaskBits ? 0 : remaining >> Last << Last;
+					if constexpr (CanStream)
+					{
+						const Rect Start = tile_rect(First, row);
+						const Rect End   = tile_rect(Last - 1, row);
+						Run run = {this, row, First, End.right - Start.left};
+						lcd.draw_image_rgb565(
+						  {Start.left, Start.top, End.right, End.bottom},
+						  read_run,
+						  &run);
+						writes++;
+					}
+					else
+					{
+						for (uint32_t column = First; column < Last; column++)
+						{
+							draw_tile(lcd, column, row);
+							writes++;
+						}
+					}
+				}
+			}
+			return writes;
+		}
+	};
+} // namespace sonata::lcd
@@ -0,0 +1,298 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <array>
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+
+#include "async_log.hh"
+#include "format.hh"
+#include "telemetry.hh"
+
+/**
+ * Logging through the `async_log` compartment with format strings known at
+ * compile time, so that they can be left out of the firmware.
+ *
+ *     sonata::log<"Proximity is {}">(prox);
+ *
+ * By default a line is formatted on the board and sent as text, as with
+ * `sonata::async_log`.  When built with `SONATA_TOKENISED_LOG` defined (the
+ * `tokenised-log` build option), only a binary record is sent: a 32-bit
+ * token identifying the format string and the types of the arguments, then
+ * the arguments, with integers as varints so that small values take a
+ * byte, framed as a `telemetry::FrameKind::LogRecord` so that it can share
+ * the UART with telemetry.  The format strings go into
+ * the `.sonata_tokens` section, which is not allocated and so is kept in
+ * the linked ELF but stripped from the image that is loaded onto the board.
+ * `scripts/token_log_decoder.py` reads them back from the ELF and turns the
+ * records into text again, passing through any text between them.
+ *
+ * Arguments may be integers, characters, booleans, strings (of which at
+ * most `MaxStringArgument` bytes are sent), and `format::Hex` and
+ * `format::Fixed`, each formatted as by `format::format_to`.
+ */
+namespace sonata
+{
+	namespace token_log
+	{
+		/// A format string, as a template argument.
+		template<size_t N>
+		struct Format
+		{
+			char chars[N];
+
+			consteval Format(const char (&format)[N])
+			{
+				for (size_t i = 0; i < N; i++)
+				{
+					chars[i] = format[i];
+				}
+			}
+		};
+
+		/// The most bytes of a string argument sent in a record.
+		static constexpr size_t MaxStringArgument = 32;
+
+		/**
+		 * The character used in a token's signature for an argument of
+		 * type `T`, which tells the decoder how to read and format it.
+		 */
+		template<typename T>
+		consteval char type_code()
+		{
+			if constexpr (std::is_same_v<T, bool>)
+			{
+				return 'b';
+			}
+			else if constexpr (std::is_same_v<T, char>)
+			{
+				return 'c';
+			}
+			else if constexpr (std::is_integral_v<T>)
+			{
+				constexpr bool Wide = sizeof(T) > sizeof(uint32_t);
+				if constexpr (std::is_signed_v<T>)
+				{
+					return Wide ? 'I' : 'i';
+				}
+				else
+				{
+					return Wide ? 'U' : 'u';
+				}
+			}
+			else if constexpr (std::is_same_v<T, format::Hex>)
+			{
+				return 'x';
+			}
+			else if constexpr (std::is_same_v<T, format::Fixed>)
+			{
+				return 'f';
+			}
+			else
+			{
+				static_assert(std::is_same_v<T, const char *> ||
+				                std::is_same_v<T, char *>,
+				              "This type can't be logged");
+				return 's';
+			}
+		}
+
+		/// The 32-bit FNV-1a hash of `length` bytes at `data`, from `hash`.
+		consteval uint32_t
+		fnv1a(const char *data, size_t length, uint32_t hash = 2166136261U)
+		{
+			for (size_t i = 0; i < length; i++)
+			{
+				hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619U;
+			}
+			return hash;
+		}
+
+		/**
+		 * The entry for one format string and argument types: the bytes of
+		 * its signature and format string, each NUL-terminated, and the
+		 * token that identifies it, their hash.
+		 */
+		template<Format Text, typename... Args>
+		struct Entry
+		{
+			static constexpr char Signature[] = {type_code<Args>()..., '\0'};
+			static constexpr size_t SignatureLength = sizeof...(Args) + 1;
+			static constexpr size_t Length =
+			  SignatureLength + sizeof(Text.chars);
+
+			static constexpr std::array<char, Length> Bytes = [] {
+				std::array<char, Length> bytes{};
+				for (size_t i = 0; i < SignatureLength; i++)
+				{
+					bytes[i] = Signature[i];
+				}
+				for (size_t i = 0; i < sizeof(Text.chars); i++)
+				{
+					bytes[SignatureLength + i] = Text.chars[i];
+				}
+				return bytes;
+			}();
+
+			static constexpr uint32_t Token = fnv1a(Bytes.data(), Length);
+
+			/// Add one byte of the entry to the `.sonata_tokens` section.
+			template<size_t Index>
+			[[gnu::always_inline]] static void emit_byte()
+			{
+				asm volatile(".pushsection .sonata_tokens,\"\",@progbits\n"
+				             ".byte %c0\n"
+				             ".popsection" ::"i"(Bytes[Index]));
+			}
+
+			/**
+			 * Add the entry to the `.sonata_tokens` section: the token, the
+			 * length as 16 bits, then the bytes.  Nothing is added to the
+			 * code; the decoder checks each entry against its token.
+			 */
+			template<size_t... Indices>
+			[[gnu::always_inline]] static void
+			emit(std::index_sequence<Indices...>)
+			{
+				asm volatile(".pushsection .sonata_tokens,\"\",@progbits\n"
+				             ".4byte %c0\n"
+				             ".2byte %c1\n"
+				             ".popsection" ::"i"(Token),
+				             "i"(Length));
+				(emit_byte<Indices>(), ...);
+			}
+		};
+
+		/**
+		 * A binary record being built, which is dropped whole rather than
+		 * truncated if its arguments don't fit.  It is built in place as
+		 * the payload of a frame, after the frame kind and with room left
+		 * for the CRC.
+		 */
+		class Record
+		{
+			uint8_t bytes[telemetry::MaxPayload];
+			size_t  used     = 1;
+			bool    overflow = false;
+
+			void put(const void *data, size_t length)
+			{
+				if (used + length + 2 > sizeof(bytes))
+				{
+					overflow = true;
+					return;
+				}
+				memcpy(bytes + used, data, length);
+				used += length;
+			}
+
+			template<typename T>
+			void put_value(T value)
+			{
+				put(&value, sizeof(value));
+			}
+
+			/**
+			 * Puts `value` as a LEB128 varint, seven bits to a byte, least
+			 * significant first, with the top bit set in all but the last,
+			 * so that small values take a byte whatever their type.
+			 */
+			void put_varint(uint64_t value)
+			{
+				while (value >= 0x80)
+				{
+					put_value(static_cast<uint8_t>(value | 0x80));
+					value >>= 7;
+				}
+				put_value(static_cast<uint8_t>(value));
+			}
+
+			/**
+			 * Puts `value` as a zigzag-encoded varint, so that small
+			 * negative values are short too.
+			 */
+			void put_signed_varint(int64_t value)
+			{
+				put_varint((static_cast<uint64_t>(value) << 1) ^
+				           static_cast<uint64_t>(value >> 63));
+			}
+
+			public:
+			explicit Record(uint32_t token)
+			{
+				put_value(token);
+			}
+
+			template<typename T>
+			void put_argument(const T &argument)
+			{
+				constexpr char Code = type_code<std::decay_t<T>>();
+				if constexpr (Code == 'b' || Code == 'c')
+				{
+					put_value(static_cast<uint8_t>(argument));
+				}
+				else if constexpr (Code == 'i' || Code == 'I')
+				{
+					put_signed_varint(static_cast<int64_t>(argument));
+				}
+				else if constexpr (Code == 'u' || Code == 'U')
+				{
+					put_varint(static_cast<uint64_t>(argument));
+				}
+				else if constexpr (Code == 'x')
+				{
+					put_varint(argument.value);
+					put_value(argument.digits);
+				}
+				else if constexpr (Code == 'f')
+				{
+					put_signed_varint(argument.value);
+					put_value(argument.fractionBits);
+					put_value(argument.decimals);
+				}
+				else
+				{
+					const size_t Length = strnlen(argument, MaxStringArgument);
+					put_value(static_cast<uint8_t>(Length));
+					put(argument, Length);
+				}
+			}
+
+			/// Send the record, or drop it if it overflowed.
+			int send()
+			{
+				if (overflow)
+				{
+					return -ENOSPC;
+				}
+				bytes[0] =
+				  static_cast<uint8_t>(telemetry::FrameKind::LogRecord);
+				return telemetry::send_payload(bytes, used);
+			}
+		};
+	} // namespace token_log
+
+	/**
+	 * Logs a line formatted from `Text` and `args`, as text or as a
+	 * tokenised record depending on the build.  Returns as
+	 * `async_log_write`.
+	 */
+	template<token_log::Format Text, typename... Args>
+	int log(const Args &...args)
+	{
+#ifdef SONATA_TOKENISED_LOG
+		using Entry = token_log::Entry<Text, std::decay_t<Args>...>;
+		Entry::emit(std::make_index_sequence<Entry::Length>());
+		token_log::Record record{Entry::Token};
+		(record.put_argument(args), ...);
+		return record.send();
+#else
+		return async_log(Text.chars, args...);
+#endif
+	}
+} // namespace sonata
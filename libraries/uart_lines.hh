@@ -0,0 +1,304 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <cheri.hh>
+#include <errno.h>
+#include <platform-uart.hh>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sample_ring.hh"
+
+namespace sonata
+{
+	/**
+	 * A line discipline for a UART that keeps up with bursts of input,
+	 * such as pasted text.  Each call to `poll` empties the whole receive
+	 * FIFO before doing anything else, and echoes from a ring of its own
+	 * only as far as the transmit FIFO has room, so it never waits on the
+	 * transmitter while bytes are arriving.
+	 *
+	 * Bytes are assembled in place into a pool of `PoolSize` line buffers,
+	 * each of `LineBytes` bytes.  A complete line, ended by a carriage
+	 * return, a newline or both, is handed to the consumer without copying,
+	 * as a read-only capability bounded to the line (without its ending).
+	 * The consumer holds the buffer until it calls `release`.  A line that
+	 * starts while every buffer is held is dropped and counted, but still
+	 * echoed; a line longer than `LineBytes` is handed over in pieces.
+	 * Backspace and delete remove the last byte of the line being entered.
+	 *
+	 * `poll` must only be called by one thread, and `next`, `wait` and
+	 * `release` by one other thread or the same one.
+	 */
+	template<size_t PoolSize = 8, size_t LineBytes = 128>
+	class UartLines
+	{
+		static_assert(PoolSize > 0 && PoolSize <= 32 &&
+		                (PoolSize & (PoolSize - 1)) == 0,
+		              "The pool size must be a power of two, at most 32");
+		static_assert(LineBytes > 0 && LineBytes <= UINT16_MAX,
+		              "A line's length must fit in 16 bits");
+
+		/// The size of the echo ring, in bytes; a power of two.
+		static constexpr uint32_t EchoBytes = 256;
+
+		/// The receive overflow bit of the UART's interrupt state.
+		static constexpr uint32_t ReceiveOverflow = 1 << 3;
+
+		/// A line waiting for the consumer.
+		struct Line
+		{
+			uint8_t  buffer;
+			uint16_t length;
+		};
+
+		char                       buffers[PoolSize][LineBytes];
+		/// Bit `i` is set while buffer `i` is being filled or is held.
+		uint32_t                   inUse = 0;
+		/// Bit `i` is set while buffer `i` is held by the consumer.
+		uint32_t                   held = 0;
+		SampleRing<Line, PoolSize> ready;
+
+		/// The buffer being filled, or -1 if there is none.
+		int32_t  current = -1;
+		uint16_t length  = 0;
+		/// Set while dropping the rest of a line that had no buffer.
+		bool     discarding = false;
+		/// Set after a carriage return, so that a following newline is
+		/// taken as part of the same line ending.
+		bool     afterReturn = false;
+		/// Set after handing over a full buffer, so that the line ending
+		/// that follows doesn't hand over an empty line as well.
+		bool     afterPiece = false;
+
+		uint8_t  echoBytes[EchoBytes];
+		uint32_t echoHead = 0;
+		uint32_t echoTail = 0;
+
+		uint32_t droppedLines  = 0;
+		uint32_t droppedEchoes = 0;
+		uint32_t overflows     = 0;
+
+		/**
+		 * Helper.  Claims a free buffer as the current one.  Returns false
+		 * if every buffer is in use.
+		 */
+		bool claim()
+		{
+			const uint32_t InUse = __atomic_load_n(&inUse, __ATOMIC_ACQUIRE);
+			for (uint32_t i = 0; i < PoolSize; i++)
+			{
+				if ((InUse & (1U << i)) == 0)
+				{
+					__atomic_fetch_or(&inUse, 1U << i, __ATOMIC_RELAXED);
+					current = static_cast<int32_t>(i);
+					length  = 0;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/// Helper.  Hands the current buffer to the consumer.
+		void hand_over()
+		{
+			__atomic_fetch_or(&held, 1U << current, __ATOMIC_RELAXED);
+			ready.push({static_cast<uint8_t>(current), length});
+			current = -1;
+		}
+
+		/**
+		 * Helper.  Queues `byte` to be echoed, or drops it if the echo ring
+		 * is full.
+		 */
+		void echo(uint8_t byte)
+		{
+			if (echoHead - echoTail == EchoBytes)
+			{
+				droppedEchoes++;
+				return;
+			}
+			echoBytes[echoHead++ % EchoBytes] = byte;
+		}
+
+		/// Helper.  Adds a received byte to the line being entered.
+		void receive(uint8_t byte, bool echoing)
+		{
+			const bool AfterReturn = afterReturn;
+			const bool AfterPiece  = afterPiece;
+			afterReturn            = byte == '\r';
+			afterPiece             = false;
+			if (byte == '\r' || byte == '\n')
+			{
+				if (byte == '\n' && AfterReturn)
+				{
+					return;
+				}
+				if (echoing)
+				{
+					echo('\r');
+					echo('\n');
+				}
+				if (discarding)
+				{
+					discarding = false;
+				}
+				else if (current < 0 && AfterPiece)
+				{
+					// The line was handed over as it filled its last buffer.
+				}
+				else if (current >= 0 || claim())
+				{
+					hand_over();
+				}
+				else
+				{
+					droppedLines++;
+				}
+				return;
+			}
+			if (byte == '\b' || byte == 0x7f)
+			{
+				if (current >= 0 && length > 0)
+				{
+					length--;
+					if (echoing)
+					{
+						echo('\b');
+						echo(' ');
+						echo('\b');
+					}
+				}
+				return;
+			}
+			if (echoing)
+			{
+				echo(byte);
+			}
+			if (discarding || (current < 0 && !claim()))
+			{
+				if (!discarding)
+				{
+					droppedLines++;
+					discarding = true;
+				}
+				return;
+			}
+			buffers[current][length++] = static_cast<char>(byte);
+			if (length == LineBytes)
+			{
+				hand_over();
+				afterPiece = true;
+			}
+		}
+
+		public:
+		/**
+		 * Empties the receive FIFO of `uart`, assembling lines, and echoes
+		 * as much as the transmit FIFO has room for, if `echoing`.  Repeats
+		 * until nothing more arrives.  Never waits.  Returns whether any
+		 * byte was received.
+		 */
+		bool poll(volatile OpenTitanUart *uart, bool echoing = true)
+		{
+			if (uart->interruptState & ReceiveOverflow)
+			{
+				uart->interruptState = ReceiveOverflow;
+				overflows++;
+			}
+			bool received = false;
+			while (true)
+			{
+				bool drained = false;
+				while (uart->can_read())
+				{
+					receive(uart->blocking_read(), echoing);
+					drained = true;
+				}
+				while (echoTail != echoHead && uart->can_write())
+				{
+					uart->blocking_write(echoBytes[echoTail++ % EchoBytes]);
+				}
+				if (!drained)
+				{
+					return received;
+				}
+				received = true;
+			}
+		}
+
+		/**
+		 * Returns the oldest complete line, setting `lineLength` to its
+		 * length, or nullptr if there is none.  The line is read-only and
+		 * bounded to its length, and is held until passed to `release`.
+		 */
+		const char *next(size_t &lineLength)
+		{
+			Line line;
+			if (!ready.pop(line))
+			{
+				return nullptr;
+			}
+			CHERI::Capability<const char> bytes{buffers[line.buffer]};
+			bytes.bounds() = line.length;
+			bytes.permissions() &=
+			  CHERI::PermissionSet{CHERI::Permission::Load,
+			                       CHERI::Permission::Global};
+			lineLength = line.length;
+			return bytes;
+		}
+
+		/**
+		 * Blocks until there is a line for `next`, or the timeout expires.
+		 * Returns whether a line is available.
+		 */
+		bool wait(Timeout *timeout)
+		{
+			return ready.wait(timeout);
+		}
+
+		/**
+		 * Returns the buffer of `line`, from `next`, to the pool.  Returns
+		 * zero, or `-EINVAL` if `line` is not a held line.
+		 */
+		int release(const char *line)
+		{
+			const ptraddr_t Base =
+			  CHERI::Capability<char>{buffers[0]}.address();
+			const ptraddr_t Address = CHERI::Capability{line}.address();
+			const size_t    Offset  = Address - Base;
+			if (Address < Base || Offset >= sizeof(buffers) ||
+			    Offset % LineBytes != 0)
+			{
+				return -EINVAL;
+			}
+			const uint32_t Bit = 1U << (Offset / LineBytes);
+			if ((__atomic_fetch_and(&held, ~Bit, __ATOMIC_RELAXED) & Bit) == 0)
+			{
+				return -EINVAL;
+			}
+			__atomic_fetch_and(&inUse, ~Bit, __ATOMIC_RELEASE);
+			return 0;
+		}
+
+		/// Returns the number of lines dropped because every buffer was held.
+		uint32_t dropped_lines()
+		{
+			return droppedLines;
+		}
+
+		/// Returns the number of bytes not echoed because the echo ring was
+		/// full.
+		uint32_t dropped_echoes()
+		{
+			return droppedEchoes;
+		}
+
+		/// Returns the number of receive FIFO overflows seen by `poll`.
+		uint32_t overflow_count()
+		{
+			return overflows;
+		}
+	};
+} // namespace sonata
@@ -0,0 +1,21 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+#include <platform-uart.hh>
+
+namespace sonata
+{
+	/**
+	 * Writes the NUL-terminated `text` to `uart`, waiting for room in the
+	 * transmit FIFO, for reports written straight to the UART rather than
+	 * logged.
+	 */
+	inline void uart_write(volatile OpenTitanUart *uart, const char *text)
+	{
+		while (*text != '\0')
+		{
+			uart->blocking_write(*text++);
+		}
+	}
+} // namespace sonata
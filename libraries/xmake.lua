@@ -1,9 +1,52 @@
 -- Copyright lowRISC Contributors.
 -- SPDX-License-Identifier: Apache-2.0
 
+compartment("spi_manager")
+  -- This compartment uses C++ thread-safe static initialisation and so
+  -- depends on the C++ runtime.
+  add_deps("cxxrt")
+  add_files("spi_manager.cc")
+
+-- Takes log lines off the threads that produce them, writing them to the
+-- UART from a low-priority thread running async_log_drain.
+compartment("async_log")
+  add_files("async_log.cc")
+  instrumented()
+
+-- Samples the call stacks of the threads in compartments built with the
+-- profile option, from a high-priority thread running profiler_run, and
+-- writes them out from a low-priority thread running profiler_write.
+compartment("profiler")
+  add_files("profiler.cc")
+
+-- Accounts for the cycles run by each thread that checkpoints, and for idle
+-- time, reported by a high-priority thread running thread_stats_report. The
+-- RTOS must be built with --scheduler-accounting=y.
+compartment("thread_stats")
+  add_files("thread_stats.cc")
+
+-- Logs the stack depths measured in compartments built with the
+-- stack-usage option, from a thread running stack_usage_report.
+compartment("stack_usage")
+  add_files("stack_usage.cc")
+
 library("lcd")
   set_default(false)
+  add_deps("spi_manager")
   add_files("../third_party/display_drivers/core/lcd_base.c")
   add_files("../third_party/display_drivers/core/m3x6_16pt.c")
   add_files("../third_party/display_drivers/st7735/lcd_st7735.c")
   add_files("lcd.cc")
+
+library("spi_flash")
+  set_default(false)
+  add_deps("spi_manager")
+  add_files("spi_flash.cc")
+  add_files("asset_store.cc")
+
+compartment("lcd_service")
+  -- This compartment uses C++ thread-safe static initialisation and so
+  -- depends on the C++ runtime.
+  add_deps("lcd", "spi_flash", "cxxrt", "debug")
+  add_files("lcd_service.cc")
+  instrumented()
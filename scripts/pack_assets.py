@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+# Copyright lowRISC Contributors.
+# SPDX-License-Identifier: Apache-2.0
+
+"""Sonata Asset Packer
+
+Packs images and other files into an asset store image, to be written to the
+board's SPI flash and read by `sonata::flash::AssetStore`. Each asset is
+given as NAME=PATH, optionally followed by :WIDTHxHEIGHT for RGB565 images.
+PATH is either a raw binary file or a C header holding a single byte array,
+such as `examples/all/lowrisc_logo.h`.
+
+    pack_assets.py assets.bin lowrisc_logo=examples/all/lowrisc_logo.h:105x80
+"""
+
+import argparse
+import re
+import struct
+import sys
+from dataclasses import dataclass
+from pathlib import Path
+
+MAGIC: int = 0x54534153  # "SAST"
+HEADER_FORMAT: str = "<II"
+ENTRY_FORMAT: str = "<16sIIHHHH"
+MAX_NAME_LENGTH: int = 15
+DATA_ALIGNMENT: int = 4
+
+FORMAT_RAW: int = 0
+FORMAT_RGB565: int = 1
+
+ARRAY_PATTERN = re.compile(r"\{([^}]*)\}", re.DOTALL)
+SPEC_PATTERN = re.compile(
+    r"^(?P<name>[^=]+)=(?P<path>.+?)(?::(?P<w>\d+)x(?P<h>\d+))?$"
+)
+
+
+@dataclass
+class AssetSpec:
+    """An asset to pack, as given on the command line."""
+
+    name: str
+    data: bytes
+    width: int = 0
+    height: int = 0
+
+    @property
+    def format(self) -> int:
+        return FORMAT_RGB565 if self.width and self.height else FORMAT_RAW
+
+
+def read_data(path: Path) -> bytes:
+    """Read an asset's data from a raw binary or a C header byte array."""
+    if path.suffix not in (".h", ".hh"):
+        return path.read_bytes()
+    match = ARRAY_PATTERN.search(path.read_text())
+    if match is None:
+        raise ValueError(f"{path}: no array initialiser found")
+    values = [v.strip() for v in match.group(1).split(",")]
+    return bytes(int(v, 0) for v in values if v)
+
+
+def parse_spec(spec: str) -> AssetSpec:
+    """Parse a NAME=PATH[:WIDTHxHEIGHT] asset argument."""
+    match = SPEC_PATTERN.match(spec)
+    if match is None:
+        raise ValueError(f"'{spec}' is not NAME=PATH[:WIDTHxHEIGHT]")
+    name = match.group("name")
+    if len(name.encode()) > MAX_NAME_LENGTH:
+        raise ValueError(f"'{name}' is longer than {MAX_NAME_LENGTH} bytes")
+    asset = AssetSpec(name, read_data(Path(match.group("path"))))
+    if match.group("w") is not None:
+        asset.width = int(match.group("w"))
+        asset.height = int(match.group("h"))
+        expected = asset.width * asset.height * 2
+        if len(asset.data) < expected:
+            raise ValueError(
+                f"'{name}' has {len(asset.data)} bytes, but a "
+                f"{asset.width}x{asset.height} image needs {expected}"
+            )
+    return asset
+
+
+def pack(assets: list[AssetSpec]) -> bytes:
+    """Build the store: the header, the index, then the aligned data."""
+    entry_size = struct.calcsize(ENTRY_FORMAT)
+    index_size = struct.calcsize(HEADER_FORMAT) + len(assets) * entry_size
+    header = struct.pack(HEADER_FORMAT, MAGIC, len(assets))
+    entries = b""
+    data = b""
+    for asset in assets:
+        padding = -(index_size + len(data)) % DATA_ALIGNMENT
+        data += b"\0" * padding
+        entries += struct.pack(
+            ENTRY_FORMAT,
+            asset.name.encode(),
+            index_size + len(data),
+            len(asset.data),
+            asset.width,
+            asset.height,
+            asset.format,
+            0,
+        )
+        data += asset.data
+    return header + entries + data
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("output", type=Path, help="The store image to write.")
+    parser.add_argument(
+        "assets", nargs="+", help="Assets, as NAME=PATH[:WIDTHxHEIGHT]."
+    )
+    args = parser.parse_args()
+    try:
+        assets = [parse_spec(spec) for spec in args.assets]
+    except (OSError, ValueError) as error:
+        print(f"error: {error}", file=sys.stderr)
+        return 2
+    names = [asset.name for asset in assets]
+    if len(set(names)) != len(names):
+        print("error: asset names must be unique", file=sys.stderr)
+        return 2
+    image = pack(assets)
+    args.output.write_bytes(image)
+    print(f"Packed {len(assets)} asset(s) into {len(image)} bytes")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,254 @@
+#!/usr/bin/env python3
+# Copyright lowRISC Contributors.
+# SPDX-License-Identifier: Apache-2.0
+
+"""Sonata Profile Report
+
+Turns the samples written out by the `profiler` compartment, in firmware built
+with the `profile` option, into a flat profile and a flame graph. Function
+names come from the firmware's `.dump` and compartments and threads from its
+`.json` report, both written by the build next to the firmware.
+
+    profile_report.py build/cheriot/cheriot/release/sonata_demo_everything \\
+        --input uart0.log --flame-graph profile.svg
+"""
+
+import argparse
+import bisect
+import json
+import re
+import sys
+import zlib
+from collections import Counter
+from dataclasses import dataclass, field
+from html import escape
+from pathlib import Path
+from typing import Any, TextIO
+
+SAMPLE_PATTERN = re.compile(r"profile: (.*)$")
+LABEL_PATTERN = re.compile(r"^([0-9a-f]+) <(.+)>:$")
+UNATTRIBUTED: str = "(unattributed)"
+
+FLAME_WIDTH: int = 1200
+FLAME_ROW_HEIGHT: int = 16
+
+
+@dataclass
+class Symbols:
+    """Maps code addresses to functions, compartments and threads."""
+
+    starts: list[int] = field(default_factory=list)
+    names: list[str] = field(default_factory=list)
+    regions: list[tuple[int, int, str]] = field(default_factory=list)
+    threads: dict[int, str] = field(default_factory=dict)
+
+    def function(self, address: int) -> str:
+        """The function containing `address`, with its compartment."""
+        index = bisect.bisect_right(self.starts, address) - 1
+        name = self.names[index] if index >= 0 else f"{address:#x}"
+        for start, end, compartment in self.regions:
+            if start <= address < end:
+                return f"{compartment}:{name}"
+        return name
+
+    def thread(self, thread: int) -> str:
+        """The name of the thread with ID `thread`."""
+        return self.threads.get(thread, f"thread {thread}")
+
+
+def read_symbols(firmware: Path) -> Symbols:
+    """Read the symbols from a firmware's `.dump` and `.json` report."""
+    symbols = Symbols()
+    functions = {}
+    with firmware.with_suffix(".dump").open() as dump:
+        for line in dump:
+            if match := LABEL_PATTERN.match(line.strip()):
+                functions[int(match[1], 16)] = match[2]
+    symbols.starts = sorted(functions)
+    symbols.names = [functions[start] for start in symbols.starts]
+
+    report: dict[str, Any] = json.loads(
+        firmware.with_suffix(".json").read_text()
+    )
+    for kind in ("compartments", "libraries"):
+        for name, entry in report.get(kind, {}).items():
+            code = entry.get("code", {})
+            if "start" in code and "end" in code:
+                symbols.regions.append((code["start"], code["end"], name))
+    for index, thread in enumerate(report.get("threads", []), start=1):
+        compartment = thread.get(
+            "compartment_name", thread.get("compartment", "?")
+        )
+        entry_point = thread.get("entry_point", "?")
+        symbols.threads[index] = f"{compartment}.{entry_point}"
+    return symbols
+
+
+@dataclass
+class Profile:
+    """The samples read from the UART output, as symbolised stacks."""
+
+    stacks: Counter[tuple[str, ...]] = field(default_factory=Counter)
+    tick_hz: int = 0
+    skipped: int = 0
+
+    @property
+    def total(self) -> int:
+        return sum(self.stacks.values())
+
+
+def read_samples(lines: TextIO, symbols: Symbols) -> Profile:
+    """Read every dump of samples in the UART output.
+
+    Each sample is a thread ID, zero if unattributed, then optionally `...`
+    if outer calls were left out, then the address of each function called,
+    outermost first.
+    """
+    profile = Profile()
+    for line in lines:
+        match = SAMPLE_PATTERN.search(line.strip())
+        if match is None:
+            continue
+        words = match[1].split()
+        if not words:
+            continue
+        if words[0] in ("begin", "end"):
+            for word in words[1:]:
+                key, _, value = word.partition("=")
+                if key == "hz":
+                    profile.tick_hz = int(value)
+                elif key == "skipped":
+                    profile.skipped += int(value)
+            continue
+        thread = int(words[0])
+        if thread == 0:
+            profile.stacks[(UNATTRIBUTED,)] += 1
+            continue
+        frames = [
+            symbols.function(int(word, 16))
+            for word in words[1:]
+            if word != "..."
+        ]
+        truncated = ["..."] if "..." in words else []
+        stack = (symbols.thread(thread), *truncated, *frames)
+        profile.stacks[stack] += 1
+    return profile
+
+
+def print_flat(profile: Profile, output: TextIO) -> None:
+    """Print each function's samples, in it and in its callees."""
+    total = profile.total
+    own: Counter[str] = Counter()
+    inclusive: Counter[str] = Counter()
+    threads: Counter[str] = Counter()
+    for stack, count in profile.stacks.items():
+        threads[stack[0]] += count
+        own[stack[-1]] += count
+        for frame in set(stack[1:]) - {"..."}:
+            inclusive[frame] += count
+
+    seconds = f", {total / profile.tick_hz:.1f}s" if profile.tick_hz else ""
+    print(f"{total} samples{seconds}, {profile.skipped} skipped", file=output)
+    print(f"\n{'self %':>8} {'total %':>8}  thread", file=output)
+    for thread, count in threads.most_common():
+        print(f"{100 * count / total:8.1f} {'':>8}  {thread}", file=output)
+    print(f"\n{'self %':>8} {'total %':>8}  function", file=output)
+    for function, count in own.most_common():
+        total_count = inclusive.get(function, count)
+        print(
+            f"{100 * count / total:8.1f} {100 * total_count / total:8.1f}  "
+            f"{function}",
+            file=output,
+        )
+
+
+def write_folded(profile: Profile, output: TextIO) -> None:
+    """Write the stacks in the folded format read by flame graph tools."""
+    for stack, count in sorted(profile.stacks.items()):
+        print(f"{';'.join(stack)} {count}", file=output)
+
+
+def write_flame_graph(profile: Profile, output: TextIO) -> None:
+    """Write a flame graph of the stacks as an SVG image."""
+    tree: dict[str, Any] = {}
+    for stack, count in profile.stacks.items():
+        node = tree
+        for frame in stack:
+            child = node.setdefault(frame, {"count": 0, "children": {}})
+            child["count"] += count
+            node = child["children"]
+    height = max(len(stack) for stack in profile.stacks) * FLAME_ROW_HEIGHT
+
+    print(
+        f'<svg xmlns="http://www.w3.org/2000/svg" width="{FLAME_WIDTH}" '
+        f'height="{height}" font-family="monospace" font-size="11">',
+        file=output,
+    )
+
+    def draw(node: dict[str, Any], x: float, depth: int) -> None:
+        # Roots are drawn at the bottom, as is usual for flame graphs.
+        y = height - (depth + 1) * FLAME_ROW_HEIGHT
+        for name, child in sorted(node.items()):
+            width = FLAME_WIDTH * child["count"] / profile.total
+            hue = zlib.crc32(name.encode()) % 40
+            print(
+                f"<g><title>{escape(name)} ({child['count']} samples)"
+                f'</title><rect x="{x:.1f}" y="{y}" width="{width:.1f}" '
+                f'height="{FLAME_ROW_HEIGHT - 1}" fill="hsl({hue},80%,60%)"/>'
+                f'<text x="{x + 2:.1f}" y="{y + FLAME_ROW_HEIGHT - 4}">'
+                f"{escape(name[: int(width / 7)])}</text></g>",
+                file=output,
+            )
+            draw(child["children"], x, depth + 1)
+            x += width
+
+    draw(tree, 0, 0)
+    print("</svg>", file=output)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "firmware",
+        type=Path,
+        help="The firmware, whose .dump and .json files are read",
+    )
+    parser.add_argument(
+        "--input",
+        type=Path,
+        help="Captured UART output with the samples, rather than stdin",
+    )
+    parser.add_argument(
+        "--folded", type=Path, help="Write the stacks in folded format"
+    )
+    parser.add_argument(
+        "--flame-graph", type=Path, help="Write a flame graph as SVG"
+    )
+    args = parser.parse_args()
+
+    try:
+        symbols = read_symbols(args.firmware)
+    except (OSError, ValueError) as error:
+        print(f"{args.firmware}: {error}", file=sys.stderr)
+        return 1
+    if args.input is not None:
+        with args.input.open(errors="replace") as lines:
+            profile = read_samples(lines, symbols)
+    else:
+        profile = read_samples(sys.stdin, symbols)
+    if profile.total == 0:
+        print("No samples found", file=sys.stderr)
+        return 1
+
+    print_flat(profile, sys.stdout)
+    if args.folded is not None:
+        with args.folded.open("w") as output:
+            write_folded(profile, output)
+    if args.flame_graph is not None:
+        with args.flame_graph.open("w") as output:
+            write_flame_graph(profile, output)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
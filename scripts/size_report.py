@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+# Copyright lowRISC Contributors.
+# SPDX-License-Identifier: Apache-2.0
+
+"""Sonata Size Report
+
+Breaks a firmware image down by compartment and library into code, read-only
+data, writable globals and the stacks of the threads that start in each, from
+the `.json` report and `.dump` written by the build next to the firmware, and
+checks them against the budgets in `size_budget.toml`. Read-only data is
+kept with a compartment's code, and is told apart by the data objects in the
+`.dump`'s symbol table; without a `.dump` it is counted as code.
+
+    size_report.py build/cheriot/cheriot/release/sonata_simple_demo
+    size_report.py --check build/cheriot/cheriot/release/sonata_simple_demo
+    size_report.py --update build/cheriot/cheriot/release/sonata_simple_demo
+
+The build runs it with `--check` before converting each firmware to UF2,
+which fails if any part of the firmware has grown beyond its budget, a part
+without a budget has appeared, or the firmware has no budgets at all.
+"""
+
+import argparse
+import json
+import re
+import sys
+import tomllib
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Any, TextIO
+
+SYMBOL_PATTERN = re.compile(r"^([0-9a-f]+) (.{7}) (\S+)\s+([0-9a-f]+) (.+)$")
+
+CATEGORIES: tuple[str, ...] = ("code", "rodata", "data", "stacks")
+
+# Budgets written by --update are rounded up to a multiple of this.
+BUDGET_GRANULE: int = 64
+
+BUDGET_HEADER: str = """\
+# Copyright lowRISC Contributors.
+# SPDX-License-Identifier: Apache-2.0
+
+# The most code, read-only data, writable globals and thread stack, in bytes,
+# that each compartment and library of a firmware image may take, checked by
+# scripts/size_report.py when the firmware is built. A firmware without a
+# table here fails the check, so a new firmware needs one generated from its
+# first build. After a change that grows a firmware on purpose, rebuild it
+# and regenerate its budgets with:
+#
+#     scripts/size_report.py --update build/cheriot/cheriot/release/<firmware>
+"""
+
+Budgets = dict[str, dict[str, dict[str, int]]]
+
+
+@dataclass
+class Part:
+    """A compartment or library, and the memory it takes."""
+
+    name: str
+    code_start: int = 0
+    code_end: int = 0
+    rodata: int = 0
+    data: int = 0
+    stacks: int = 0
+
+    @property
+    def code(self) -> int:
+        return self.code_end - self.code_start - self.rodata
+
+    def size(self, category: str) -> int:
+        """The bytes taken in `category`, one of `CATEGORIES`."""
+        sizes = {
+            "code": self.code,
+            "rodata": self.rodata,
+            "data": self.data,
+            "stacks": self.stacks,
+        }
+        return sizes[category]
+
+
+def region(entry: dict[str, Any], kind: str) -> tuple[int, int]:
+    """The start and end of a part's `kind` region in the `.json` report."""
+    bounds = entry.get(kind, {})
+    return bounds.get("start", 0), bounds.get("end", 0)
+
+
+def read_parts(firmware: Path) -> dict[str, Part]:
+    """Read the parts of a firmware from its `.json` report and `.dump`."""
+    report: dict[str, Any] = json.loads(
+        firmware.with_suffix(".json").read_text()
+    )
+    parts: dict[str, Part] = {}
+    for kind in ("compartments", "libraries"):
+        for name, entry in report.get(kind, {}).items():
+            part = Part(name)
+            part.code_start, part.code_end = region(entry, "code")
+            data_start, data_end = region(entry, "data")
+            part.data = data_end - data_start
+            parts[name] = part
+    for thread in report.get("threads", []):
+        name = thread.get("compartment_name", thread.get("compartment"))
+        if name in parts:
+            parts[name].stacks += thread.get("stack_size", 0)
+
+    dump = firmware.with_suffix(".dump")
+    if dump.exists():
+        with dump.open(errors="replace") as lines:
+            for line in lines:
+                match = SYMBOL_PATTERN.match(line.rstrip())
+                if match is None or match[2][-1] != "O":
+                    continue
+                address = int(match[1], 16)
+                for part in parts.values():
+                    if part.code_start <= address < part.code_end:
+                        part.rodata += int(match[4], 16)
+                        break
+    return parts
+
+
+def read_budgets(path: Path) -> Budgets:
+    """Read the budgets of every firmware from the budget file."""
+    if not path.exists():
+        return {}
+    with path.open("rb") as budget_file:
+        budgets: Budgets = tomllib.load(budget_file)
+    return budgets
+
+
+def write_budgets(path: Path, budgets: Budgets) -> None:
+    """Write the budgets of every firmware to the budget file."""
+    with path.open("w") as output:
+        output.write(BUDGET_HEADER)
+        for firmware, parts in sorted(budgets.items()):
+            for name, sizes in sorted(parts.items()):
+                output.write(f"\n[{firmware}.{name}]\n")
+                for category in CATEGORIES:
+                    output.write(f"{category} = {sizes.get(category, 0)}\n")
+
+
+def budget_for(
+    parts: dict[str, Part], slack: int
+) -> dict[str, dict[str, int]]:
+    """Budgets for `parts`, with `slack` percent more than each takes."""
+    budget = {}
+    for name, part in parts.items():
+        sizes = {}
+        for category in CATEGORIES:
+            size = part.size(category) * (100 + slack) // 100
+            sizes[category] = -(-size // BUDGET_GRANULE) * BUDGET_GRANULE
+        budget[name] = sizes
+    return budget
+
+
+def check(
+    parts: dict[str, Part], budget: dict[str, dict[str, int]]
+) -> list[str]:
+    """Return a description of each way in which `parts` exceed `budget`."""
+    problems = []
+    for name, part in sorted(parts.items()):
+        if name not in budget:
+            problems.append(f"{name} has no budget")
+            continue
+        for category in CATEGORIES:
+            size = part.size(category)
+            limit = budget[name].get(category, 0)
+            if size > limit:
+                problems.append(
+                    f"{name} {category} is {size} bytes, "
+                    f"over its budget of {limit} by {size - limit}"
+                )
+    return problems
+
+
+def print_report(parts: dict[str, Part], output: TextIO) -> None:
+    """Print the size of each part in each category, and the totals."""
+    print(
+        "".join(f"{category:>9}" for category in CATEGORIES) + "  part",
+        file=output,
+    )
+    totals = dict.fromkeys(CATEGORIES, 0)
+    for part in sorted(
+        parts.values(),
+        key=lambda part: part.code_end - part.code_start,
+        reverse=True,
+    ):
+        for category in CATEGORIES:
+            totals[category] += part.size(category)
+        sizes = "".join(f"{part.size(category):>9}" for category in CATEGORIES)
+        print(f"{sizes}  {part.name}", file=output)
+    sizes = "".join(f"{totals[category]:>9}" for category in CATEGORIES)
+    print(f"{sizes}  total", file=output)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "firmware",
+        type=Path,
+        help="The firmware, whose .json and .dump files are read",
+    )
+    parser.add_argument(
+        "--budget",
+        type=Path,
+        default=Path(__file__).parent.parent / "size_budget.toml",
+        help="The budget file (default: %(default)s)",
+    )
+    mode = parser.add_mutually_exclusive_group()
+    mode.add_argument(
+        "--check",
+        action="store_true",
+        help="Fail if the firmware exceeds its budget, printing only then",
+    )
+    mode.add_argument(
+        "--update",
+        action="store_true",
+        help="Set the firmware's budget from its current size",
+    )
+    parser.add_argument(
+        "--slack",
+        type=int,
+        default=10,
+        help="Percentage of headroom given by --update (default: %(default)s)",
+    )
+    args = parser.parse_args()
+
+    name = args.firmware.name
+    try:
+        parts = read_parts(args.firmware)
+        budgets = read_budgets(args.budget)
+    except (OSError, ValueError) as error:
+        print(f"{name}: {error}", file=sys.stderr)
+        return 1
+
+    if args.update:
+        budgets[name] = budget_for(parts, args.slack)
+        write_budgets(args.budget, budgets)
+        print(f"{name}: budget written to {args.budget}")
+        return 0
+    if not args.check:
+        print_report(parts, sys.stdout)
+        return 0
+    if name not in budgets:
+        print(
+            f"{name}: no budget in {args.budget}; generate one with "
+            f"{Path(__file__).name} --update",
+            file=sys.stderr,
+        )
+        return 1
+    problems = check(parts, budgets[name])
+    if not problems:
+        return 0
+    print_report(parts, sys.stderr)
+    for problem in problems:
+        print(f"{name}: {problem}", file=sys.stderr)
+    print(
+        f"{name}: if this growth is expected, update the budget with "
+        f"{Path(__file__).name} --update",
+        file=sys.stderr,
+    )
+    return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+# Copyright lowRISC Contributors.
+# SPDX-License-Identifier: Apache-2.0
+
+"""Sonata Stack Report
+
+Compares the stack usage printed by the `stack_usage` compartment, in firmware
+built with the `stack-usage` option, with each thread's `stack_size` in the
+firmware's `.json` report, written by the build next to the firmware, and
+suggests sizes with a safety margin. Stack used by uninstrumented code, such
+as the RTOS, isn't measured, which the margin must allow for.
+
+    stack_report.py build/cheriot/cheriot/release/sonata_demo_everything \\
+        --input uart0.log --check
+"""
+
+import argparse
+import json
+import re
+import sys
+from dataclasses import dataclass
+from pathlib import Path
+from typing import Any, TextIO
+
+USAGE_PATTERN = re.compile(r"stack_usage: (.*)$")
+
+# Stack sizes are suggested in multiples of this, as in the firmware
+# definitions.
+STACK_GRANULE: int = 0x100
+
+
+@dataclass
+class Thread:
+    """A thread of the firmware, and the most stack it was seen to use."""
+
+    name: str
+    stack_size: int | None
+    used: int | None = None
+
+    def suggested(self, margin: int) -> int | None:
+        """The stack size to give the thread, with `margin` percent more
+        than it used."""
+        if self.used is None:
+            return None
+        size = self.used * (100 + margin) // 100
+        return -(-size // STACK_GRANULE) * STACK_GRANULE
+
+
+def read_threads(firmware: Path) -> dict[int, Thread]:
+    """Read the firmware's threads, by ID, from its `.json` report."""
+    report: dict[str, Any] = json.loads(
+        firmware.with_suffix(".json").read_text()
+    )
+    threads = {}
+    for index, thread in enumerate(report.get("threads", []), start=1):
+        compartment = thread.get(
+            "compartment_name", thread.get("compartment", "?")
+        )
+        entry_point = thread.get("entry_point", "?")
+        threads[index] = Thread(
+            f"{compartment}.{entry_point}", thread.get("stack_size")
+        )
+    return threads
+
+
+def read_usage(lines: TextIO, threads: dict[int, Thread]) -> int:
+    """Read the stack usage in the UART output, keeping the most used by
+    each thread, and return the number of reports read."""
+    reports = 0
+    for line in lines:
+        match = USAGE_PATTERN.search(line.strip())
+        if match is None:
+            continue
+        fields = {}
+        for word in match[1].split():
+            key, _, value = word.partition("=")
+            fields[key] = value
+        try:
+            thread_id = int(fields["thread"])
+            size = int(fields["size"])
+            used = int(fields["used"])
+        except (KeyError, ValueError):
+            continue
+        thread = threads.setdefault(
+            thread_id, Thread(f"thread {thread_id}", size)
+        )
+        if thread.stack_size is None:
+            thread.stack_size = size
+        thread.used = max(used, thread.used or 0)
+        reports += 1
+    return reports
+
+
+def print_report(
+    threads: dict[int, Thread], margin: int, output: TextIO
+) -> bool:
+    """Print each thread's stack size, usage and suggested size, and return
+    whether every measured thread's stack is at least its suggested size."""
+    ok = True
+    print(
+        f"{'size':>8} {'used':>8} {'suggested':>9}  {'status':<12} thread",
+        file=output,
+    )
+    for thread in threads.values():
+        suggested = thread.suggested(margin)
+        if suggested is None or thread.stack_size is None:
+            status = "not measured"
+        elif thread.stack_size < suggested:
+            status = "too small"
+            ok = False
+        elif thread.stack_size > suggested:
+            status = "can shrink"
+        else:
+            status = "ok"
+        print(
+            f"{format_size(thread.stack_size):>8} "
+            f"{format_size(thread.used):>8} "
+            f"{format_size(suggested):>9}  {status:<12} {thread.name}",
+            file=output,
+        )
+    return ok
+
+
+def format_size(size: int | None) -> str:
+    """A size in bytes as written in the firmware definitions."""
+    return "-" if size is None else f"{size:#x}"
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "firmware", type=Path, help="The firmware, whose .json file is read"
+    )
+    parser.add_argument(
+        "--input",
+        type=Path,
+        help="Captured UART output with the stack usage, rather than stdin",
+    )
+    parser.add_argument(
+        "--margin",
+        type=int,
+        default=25,
+        help="Percentage to add to the stack used (default: %(default)s)",
+    )
+    parser.add_argument(
+        "--check",
+        action="store_true",
+        help="Fail if any thread's stack is smaller than suggested",
+    )
+    args = parser.parse_args()
+
+    try:
+        threads = read_threads(args.firmware)
+    except (OSError, ValueError) as error:
+        print(f"{args.firmware}: {error}", file=sys.stderr)
+        return 1
+    if args.input is not None:
+        with args.input.open(errors="replace") as lines:
+            reports = read_usage(lines, threads)
+    else:
+        reports = read_usage(sys.stdin, threads)
+    if reports == 0:
+        print("No stack usage found", file=sys.stderr)
+        return 1
+
+    ok = print_report(threads, args.margin, sys.stdout)
+    return 1 if args.check and not ok else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+# Copyright lowRISC Contributors.
+# SPDX-License-Identifier: Apache-2.0
+
+"""Sonata Telemetry Collector
+
+Collects the frames sent by `sonata::telemetry::Channel` from the board's UART
+or the simulator's UART log, and writes each channel's samples to a CSV file
+named after it. Text between frames is passed through to stdout, and the
+frames holding `sonata::log` records, in firmware built with the
+`tokenised-log` option, are left to `token_log_decoder.py`. The same frames are
+sent by the simulator and by the board, so the output is the same.
+
+    telemetry_collector.py --output-dir telemetry fpga /dev/ttyUSB2
+    telemetry_collector.py --output-dir telemetry sim --uart-log uart0.log
+"""
+
+import argparse
+import csv
+import struct
+import sys
+import time
+from collections.abc import Iterator
+from dataclasses import dataclass
+from pathlib import Path
+from typing import TextIO
+
+from test_runner import TICK_SECONDS, fpga_readlines, simulation_readlines
+
+HEADER_FORMAT: str = "<BBHQ"
+DESCRIBE_FORMAT: str = "<BBI"
+FRAME_DESCRIBE: int = 1
+FRAME_SAMPLE: int = 2
+FRAME_LOG_RECORD: int = 3
+# The longest frame, delimiters included. Anything longer without a zero in it
+# can only be text.
+MAX_FRAME: int = 120
+
+# The `struct` format of each `sonata::telemetry::ValueType`, by its number.
+VALUE_FORMATS: list[str] = ["B", "b", "H", "h", "I", "i", "Q", "q", "f"]
+
+
+def crc16(data: bytes) -> int:
+    """The CRC-16/CCITT, with an initial value of 0xffff, of `data`."""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = (crc << 1) ^ 0x1021 if crc & 0x8000 else crc << 1
+        crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data: bytes) -> bytes | None:
+    """Decode a COBS-encoded frame body, or return None if it isn't one."""
+    decoded = bytearray()
+    offset = 0
+    while offset < len(data):
+        code = data[offset]
+        end = offset + code
+        if code == 0 or end > len(data):
+            return None
+        decoded += data[offset + 1 : end]
+        offset = end
+        if code != 0xFF and offset < len(data):
+            decoded.append(0)
+    return bytes(decoded)
+
+
+def unframe(segment: bytes) -> bytes | None:
+    """Return the payload of a frame, starting with its kind and without its
+    CRC, or None if the frame is not valid."""
+    payload = cobs_decode(segment)
+    if payload is None or len(payload) < 3:
+        return None
+    (crc,) = struct.unpack_from("<H", payload, len(payload) - 2)
+    if crc16(payload[:-2]) != crc:
+        return None
+    return payload[:-2]
+
+
+@dataclass
+class Channel:
+    """A described channel and the CSV file its samples are written to."""
+
+    name: str
+    value_format: str
+    fields: int
+    hz: int
+    file: TextIO
+    last_sequence: int | None = None
+    samples: int = 0
+    missed: int = 0
+
+    def write_row(self, row: list[object]) -> None:
+        """Write a row to the channel's CSV file."""
+        csv.writer(self.file).writerow(row)
+        self.file.flush()
+
+
+class Collector:
+    """Splits a byte stream into frames and text, and writes out samples."""
+
+    def __init__(self, output_dir: Path) -> None:
+        self.output_dir = output_dir
+        self.channels: dict[int, Channel] = {}
+        self.buffer = bytearray()
+        self.bad_frames = 0
+        self.undescribed = 0
+
+    def feed(self, chunk: bytes) -> None:
+        """Process the next bytes of the stream."""
+        self.buffer += chunk
+        *segments, tail = self.buffer.split(b"\0")
+        for segment in segments:
+            self.segment(bytes(segment))
+        # Until a zero arrives the tail may be the start of a frame, unless
+        # it is too long to be one.
+        if len(tail) > MAX_FRAME:
+            self.text(bytes(tail))
+            tail = bytearray()
+        self.buffer = tail
+
+    def segment(self, segment: bytes) -> None:
+        """Process the bytes between two zeros, as a frame or as text."""
+        if not segment:
+            return
+        payload = unframe(segment)
+        if payload is None:
+            # Lines of text end in a newline, so anything else is a frame
+            # that was corrupted or only partly read.
+            if len(segment) <= MAX_FRAME and b"\n" not in segment:
+                self.bad_frames += 1
+            else:
+                self.text(segment)
+            return
+        if payload[0] == FRAME_LOG_RECORD:
+            return
+        if len(payload) < struct.calcsize(HEADER_FORMAT):
+            self.bad_frames += 1
+            return
+        kind, channel_id, sequence, cycles = struct.unpack_from(
+            HEADER_FORMAT, payload
+        )
+        body = payload[struct.calcsize(HEADER_FORMAT) :]
+        if kind == FRAME_DESCRIBE:
+            self.describe(channel_id, body)
+        elif kind == FRAME_SAMPLE:
+            self.sample(channel_id, sequence, cycles, body)
+
+    def text(self, data: bytes) -> None:
+        """Pass text through to stdout."""
+        sys.stdout.write(data.decode(errors="replace"))
+        sys.stdout.flush()
+
+    def describe(self, channel_id: int, body: bytes) -> None:
+        """Open a channel's CSV file the first time it is described."""
+        if channel_id in self.channels:
+            return
+        if len(body) < struct.calcsize(DESCRIBE_FORMAT):
+            return
+        value_type, fields, hz = struct.unpack_from(DESCRIBE_FORMAT, body)
+        if value_type >= len(VALUE_FORMATS) or fields == 0 or hz == 0:
+            return
+        name = body[struct.calcsize(DESCRIBE_FORMAT) :].decode(
+            errors="replace"
+        )
+        name = name or f"channel{channel_id}"
+        file = (self.output_dir / f"{name}.csv").open("w", newline="")
+        channel = Channel(name, VALUE_FORMATS[value_type], fields, hz, file)
+        values = (
+            [name] if fields == 1 else [f"{name}{i}" for i in range(fields)]
+        )
+        channel.write_row(["time_s", "sequence", *values])
+        self.channels[channel_id] = channel
+
+    def sample(
+        self, channel_id: int, sequence: int, cycles: int, body: bytes
+    ) -> None:
+        """Write a sample to its channel's CSV file."""
+        channel = self.channels.get(channel_id)
+        if channel is None:
+            # Each channel is described before its first sample and then
+            # periodically, so this is only seen when joining part-way.
+            self.undescribed += 1
+            return
+        value_format = f"<{channel.fields}{channel.value_format}"
+        if len(body) != struct.calcsize(value_format):
+            self.bad_frames += 1
+            return
+        if channel.last_sequence is not None:
+            channel.missed += (sequence - channel.last_sequence - 1) & 0xFFFF
+        channel.last_sequence = sequence
+        channel.samples += 1
+        values = struct.unpack(value_format, body)
+        channel.write_row([f"{cycles / channel.hz:.9f}", sequence, *values])
+
+    def close(self) -> None:
+        """Close the CSV files and report what was collected."""
+        for channel in self.channels.values():
+            channel.file.close()
+            print(
+                f"{channel.name}: {channel.samples} samples, "
+                f"{channel.missed} missed",
+                file=sys.stderr,
+            )
+        print(
+            f"{self.bad_frames} bad frames, "
+            f"{self.undescribed} samples before a description",
+            file=sys.stderr,
+        )
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "--output-dir",
+        type=Path,
+        default=Path("telemetry"),
+        help="Directory to write a CSV file for each channel to",
+    )
+    parser.add_argument(
+        "-t",
+        "--timeout",
+        type=int,
+        default=0,
+        help="Seconds to collect for, or zero to collect until interrupted",
+    )
+    subparsers = parser.add_subparsers(dest="command", required=True)
+    fpga = subparsers.add_parser("fpga", help="Collect from the FPGA's UART")
+    fpga.add_argument("tty", type=str, help="Serial port of the FPGA's UART")
+    sim = subparsers.add_parser(
+        "sim", help="Collect from the simulator's UART log"
+    )
+    sim.add_argument(
+        "--uart-log",
+        type=Path,
+        default=Path("uart0.log"),
+        help="UART log written by the simulator",
+    )
+    args = parser.parse_args()
+
+    args.output_dir.mkdir(parents=True, exist_ok=True)
+    chunks: Iterator[bytes] = (
+        fpga_readlines(args.tty)
+        if args.command == "fpga"
+        else simulation_readlines(args.uart_log)
+    )
+    deadline = time.monotonic() + args.timeout
+    collector = Collector(args.output_dir)
+    try:
+        for chunk in chunks:
+            if not chunk:
+                # The end of the simulator's log, for now.
+                time.sleep(TICK_SECONDS)
+            collector.feed(chunk)
+            if args.timeout and time.monotonic() > deadline:
+                break
+    except KeyboardInterrupt:
+        pass
+    collector.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -183,6 +183,28 @@ def run_simulator(config: Config) -> None:
             time.sleep(TICK_SECONDS)
 
 
+def fpga_readlines(tty: str) -> Generator[bytes, None, None]:
+    """Reads each line, as raw bytes, from the fpga serial port."""
+    with serial.Serial(tty, BAUD_RATE, timeout=2) as uart:
+        while True:
+            yield uart.readline()
+
+
+def simulation_readlines(uart_log: Path) -> Generator[bytes, None, None]:
+    """Reads each line, as raw bytes, from the simulator uart output log.
+
+    An empty line is read whenever the end of the log has been reached.
+    """
+    while True:
+        try:
+            with uart_log.open("rb") as uart:
+                while True:
+                    yield uart.readline()
+        except FileNotFoundError:
+            # Keep attempting to open the UART log file, until it exists.
+            time.sleep(TICK_SECONDS)
+
+
 def watch_output(config: Config) -> None:
     """Watches the output of either the simulator or the fpga.
 
@@ -191,31 +213,20 @@ def watch_output(config: Config) -> None:
     will run forever, so should be run in a daemon thread.
     """
 
-    def fpga_readlines() -> Generator[str, None, None]:
-        """Reads each line from the fpga serial port."""
-        with serial.Serial(config.tty, BAUD_RATE, timeout=2) as uart:
-            while True:
-                try:
-                    line = uart.readline().decode(sys.stdout.encoding)
-                except UnicodeDecodeError:
-                    # Accept garbled data gracefully. Decode errors can often
-                    # happen shortly after reloading the sonata's firmware.
-                    line = "XXX Decode Error (This is expected at the start)\n"
-                yield line
-
-    def simulation_readlines() -> Generator[str, None, None]:
-        """Reads each line from the simulator uart output log."""
-        while True:
-            try:
-                with config.uart_log.open() as uart:
-                    while True:
-                        yield uart.readline()
-            except FileNotFoundError:
-                # Keep attempting to open the UART log file, until it exists.
-                time.sleep(TICK_SECONDS)
-
-    lines = simulation_readlines() if not config.fpga else fpga_readlines()
-    for line in lines:
+    def decode(line: bytes) -> str:
+        try:
+            return line.decode(sys.stdout.encoding)
+        except UnicodeDecodeError:
+            # Accept garbled data gracefully. Decode errors can often happen
+            # shortly after reloading the sonata's firmware.
+            return "XXX Decode Error (This is expected at the start)\n"
+
+    lines = (
+        simulation_readlines(config.uart_log)
+        if not config.fpga
+        else fpga_readlines(config.tty)
+    )
+    for line in map(decode, lines):
         sys.stdout.write(line)
         if PASSED_MESSAGE in line:
             return_code.put(ReturnCode.TESTS_PASSED)
@@ -0,0 +1,303 @@
+#!/usr/bin/env python3
+# Copyright lowRISC Contributors.
+# SPDX-License-Identifier: Apache-2.0
+
+"""Sonata Tokenised Log Decoder
+
+Turns the binary records sent by `sonata::log` in firmware built with the
+`tokenised-log` option back into text. The format strings are read from the
+`.sonata_tokens` section of the firmware's ELF file, which is kept in the
+linked ELF but stripped from the image loaded onto the board. Text between
+records, such as output from `Debug::log`, is passed through unchanged, and
+telemetry frames, which are left to `telemetry_collector.py`, are skipped.
+
+    token_log_decoder.py build/cheriot/cheriot/release/sonata_proximity_demo \\
+        --tty /dev/ttyUSB2
+"""
+
+import argparse
+import struct
+import sys
+from collections.abc import Iterator
+from dataclasses import dataclass
+from pathlib import Path
+from typing import BinaryIO
+
+import serial
+from telemetry_collector import FRAME_LOG_RECORD, MAX_FRAME, unframe
+
+TOKEN_SECTION: str = ".sonata_tokens"
+BAUD_RATE: int = 115200
+ENTRY_HEADER_FORMAT: str = "<IH"
+RECORD_HEADER_FORMAT: str = "<BI"
+FNV_OFFSET: int = 2166136261
+FNV_PRIME: int = 16777619
+
+
+@dataclass
+class Entry:
+    """A format string and the types of its arguments."""
+
+    signature: str
+    text: str
+
+
+def fnv1a(data: bytes) -> int:
+    """The 32-bit FNV-1a hash used to make tokens."""
+    value = FNV_OFFSET
+    for byte in data:
+        value = ((value ^ byte) * FNV_PRIME) & 0xFFFFFFFF
+    return value
+
+
+def read_section(elf: bytes, name: str) -> bytes:
+    """Return the contents of the ELF section called `name`."""
+    if elf[:4] != b"\x7fELF" or elf[5] != 1:
+        raise ValueError("not a little-endian ELF file")
+    if elf[4] == 1:
+        shoff, shentsize, shnum, shstrndx = struct.unpack_from(
+            "<I10xHHH", elf, 0x20
+        )
+        header_format = "<II8xII"
+    else:
+        shoff, shentsize, shnum, shstrndx = struct.unpack_from(
+            "<Q10xHHH", elf, 0x28
+        )
+        header_format = "<II16xQQ"
+
+    headers = [
+        struct.unpack_from(header_format, elf, shoff + i * shentsize)
+        for i in range(shnum)
+    ]
+    _, _, names_offset, _ = headers[shstrndx]
+    for name_offset, _, offset, size in headers:
+        start = names_offset + name_offset
+        if elf[start : elf.index(b"\0", start)].decode() == name:
+            return elf[offset : offset + size]
+    raise ValueError(
+        f"no {name} section; was the firmware built with "
+        "the tokenised-log option?"
+    )
+
+
+def read_entries(elf_path: Path) -> dict[int, Entry]:
+    """Read the token table from a firmware ELF file."""
+    table = read_section(elf_path.read_bytes(), TOKEN_SECTION)
+    entries = {}
+    offset = 0
+    header_size = struct.calcsize(ENTRY_HEADER_FORMAT)
+    while offset + header_size <= len(table):
+        token, length = struct.unpack_from(ENTRY_HEADER_FORMAT, table, offset)
+        offset += header_size
+        data = table[offset : offset + length]
+        offset += length
+        if fnv1a(data) != token:
+            print(
+                f"Skipping a corrupt entry for token {token:#010x}",
+                file=sys.stderr,
+            )
+            continue
+        signature, text = data.rstrip(b"\0").split(b"\0", 1)
+        entries[token] = Entry(signature.decode(), text.decode())
+    return entries
+
+
+def format_fixed(value: int, fraction_bits: int, decimals: int) -> str:
+    """Format a fixed-point value as `sonata::format::Fixed` does."""
+    magnitude = abs(value)
+    integer = magnitude >> fraction_bits
+    scale = 10**decimals
+    decimal = (magnitude & ((1 << fraction_bits) - 1)) * scale
+    if fraction_bits > 0:
+        decimal = (decimal + (1 << (fraction_bits - 1))) >> fraction_bits
+    if decimal == scale:
+        integer += 1
+        decimal = 0
+    sign = "-" if value < 0 and (integer or decimal) else ""
+    fraction = f".{decimal:0{decimals}d}" if decimals else ""
+    return f"{sign}{integer}{fraction}"
+
+
+def read_varint(data: bytes, offset: int) -> tuple[int, int] | None:
+    """Read a LEB128 varint at `offset`, returning it and the offset after
+    it, or None if it runs past the end of `data`."""
+    value = 0
+    shift = 0
+    while offset < len(data):
+        byte = data[offset]
+        offset += 1
+        value |= (byte & 0x7F) << shift
+        if byte < 0x80:
+            return value, offset
+        shift += 7
+    return None
+
+
+def read_signed_varint(data: bytes, offset: int) -> tuple[int, int] | None:
+    """Read a zigzag-encoded varint, as `read_varint`."""
+    read = read_varint(data, offset)
+    if read is None:
+        return None
+    value, offset = read
+    return (value >> 1) ^ -(value & 1), offset
+
+
+def decode_arguments(signature: str, data: bytes) -> list[str] | None:
+    """Decode a record's arguments, or return None if they don't fit it.
+
+    Booleans and characters are a byte each, and strings a length byte
+    followed by that many bytes. Integers are varints, zigzag-encoded if
+    signed, as are the values of `Hex` and `Fixed`, which are followed by
+    their digits, and their fraction bits and decimals, a byte each.
+    """
+    arguments = []
+    offset = 0
+    for code in signature:
+        if code in "bcs":
+            if offset >= len(data):
+                return None
+            byte = data[offset]
+            offset += 1
+            match code:
+                case "b":
+                    arguments.append("true" if byte else "false")
+                case "c":
+                    arguments.append(chr(byte))
+                case _:
+                    text = data[offset : offset + byte]
+                    arguments.append(text.decode(errors="replace"))
+                    offset += byte
+            continue
+        if code not in "iIuUxf":
+            return None
+        signed = code in "iIf"
+        read = (read_signed_varint if signed else read_varint)(data, offset)
+        if read is None:
+            return None
+        value, offset = read
+        trailing = data[offset : offset + {"x": 1, "f": 2}.get(code, 0)]
+        offset += len(trailing)
+        match code:
+            case "x" if len(trailing) == 1:
+                arguments.append(f"{value:0{trailing[0]}x}")
+            case "f" if len(trailing) == 2:
+                arguments.append(format_fixed(value, *trailing))
+            case "x" | "f":
+                return None
+            case _:
+                arguments.append(str(value))
+    return arguments if offset == len(data) else None
+
+
+def substitute(text: str, arguments: list[str]) -> str:
+    """Replace each `{}` in `text` with the next argument, as `format_to`."""
+    pieces = text.split("{}", len(arguments))
+    result = pieces[0]
+    for argument, piece in zip(arguments, pieces[1:], strict=False):
+        result += argument + piece
+    return result
+
+
+def decode_segment(entries: dict[int, Entry], segment: bytes) -> bytes:
+    """Decode the bytes between two zeros: a frame holding a record into a
+    line of text, any other frame into nothing, and text into itself."""
+    payload = unframe(segment)
+    if payload is None:
+        return segment
+    if payload[0] != FRAME_LOG_RECORD:
+        return b""
+    header_size = struct.calcsize(RECORD_HEADER_FORMAT)
+    if len(payload) < header_size:
+        return b"[record too short to decode]\n"
+    _, token = struct.unpack_from(RECORD_HEADER_FORMAT, payload)
+    entry = entries.get(token)
+    arguments = (
+        None
+        if entry is None
+        else decode_arguments(entry.signature, payload[header_size:])
+    )
+    if entry is None or arguments is None:
+        return f"[undecodable record with token {token:#010x}]\n".encode()
+    return substitute(entry.text, arguments).encode() + b"\n"
+
+
+def decode(
+    entries: dict[int, Entry], chunks: Iterator[bytes]
+) -> Iterator[str]:
+    """Decode a stream of records and text into text.
+
+    Records are sent in the same COBS frames as telemetry, delimited by
+    zeros, which never appear in text. Anything between zeros that isn't a
+    frame is passed through as text, and telemetry frames are skipped.
+    """
+    buffer = bytearray()
+    for chunk in chunks:
+        buffer += chunk
+        # An empty chunk marks the end of the stream.
+        final = not chunk
+        *segments, tail = buffer.split(b"\0")
+        # Until a zero arrives the tail may be the start of a frame, unless
+        # it is too long to be one.
+        if final or len(tail) > MAX_FRAME:
+            segments.append(tail)
+            tail = bytearray()
+        buffer = tail
+        text = b"".join(
+            decode_segment(entries, bytes(segment)) for segment in segments
+        )
+        if text:
+            yield text.decode(errors="replace")
+
+
+def file_chunks(stream: BinaryIO) -> Iterator[bytes]:
+    """Read a captured log, ending with an empty chunk."""
+    while chunk := stream.read(4096):
+        yield chunk
+    yield b""
+
+
+def serial_chunks(tty: str, baud_rate: int) -> Iterator[bytes]:
+    """Read from a serial port until interrupted."""
+    with serial.Serial(tty, baud_rate, timeout=0.1) as uart:
+        while True:
+            if chunk := uart.read(uart.in_waiting or 1):
+                yield chunk
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument(
+        "elf", type=Path, help="The firmware ELF file, before stripping"
+    )
+    source = parser.add_mutually_exclusive_group(required=True)
+    source.add_argument("--tty", type=str, help="Serial port to read from")
+    source.add_argument(
+        "--input", type=Path, help="Captured UART output to decode"
+    )
+    parser.add_argument(
+        "--baud", type=int, default=BAUD_RATE, help="Serial baud rate"
+    )
+    args = parser.parse_args()
+
+    try:
+        entries = read_entries(args.elf)
+    except (OSError, ValueError) as error:
+        print(f"{args.elf}: {error}", file=sys.stderr)
+        return 1
+
+    try:
+        if args.input is not None:
+            with args.input.open("rb") as stream:
+                for text in decode(entries, file_chunks(stream)):
+                    sys.stdout.write(text)
+        else:
+            for text in decode(entries, serial_chunks(args.tty, args.baud)):
+                sys.stdout.write(text)
+                sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
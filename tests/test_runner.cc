@@ -1,6 +1,7 @@
 // Copyright lowRISC Contributors.
 // SPDX-License-Identifier: Apache-2.0
 
+#include "uart_benchmark.hh"
 #include "uart_tests.hh"
 #include <debug.hh>
 #include <platform-uart.hh>
@@ -31,6 +32,7 @@ void check_result(bool result)
 [[noreturn]] void __cheri_compartment("test_runner") run_tests()
 {
 	check_result(uart_tests());
+	check_result(uart_benchmark());
 	finish_running("All tests finished");
 }
 
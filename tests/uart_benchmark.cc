@@ -0,0 +1,279 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include <algorithm>
+#include <cheri.hh>
+#include <debug.hh>
+#include <platform-uart.hh>
+#include <riscvreg.h>
+#include <utility>
+
+/**
+ * Measures the UART in loopback, so that changes to the driver can be judged
+ * on numbers: sustained transmit and receive throughput and the latency from
+ * sending a byte to the receive watermark interrupt being raised, at each
+ * baud rate, then where each watermark level is actually crossed.
+ *
+ * Each result is logged as one line of space-separated `key=value` pairs,
+ * starting with `result=` and the name of the measurement, for example:
+ *
+ *     result=uart_throughput baud=921600 tx_bytes_per_second=83636 ...
+ *
+ * Nothing is judged here; a benchmark only fails if the loopback does.
+ */
+
+using Debug   = ConditionalDebug<true, "Uart Benchmark">;
+using UartPtr = volatile OpenTitanUart *;
+
+// The baud rates measured.
+static constexpr unsigned BaudRates[] = {115'200, 230'400, 460'800, 921'600};
+
+// The baud rate at which the watermark levels are measured.
+static constexpr unsigned WatermarkBaudRate = 921'600;
+
+// The bytes streamed through the loopback to measure throughput.
+static constexpr size_t StreamBytes = 256;
+
+// The bytes sent one at a time to measure latency.
+static constexpr uint32_t LatencySamples = 16;
+
+// Bits sent per byte: a start bit, eight data bits, parity and a stop bit.
+static constexpr uint32_t BitsPerByte = 11;
+
+// How long any one measurement may take before the loopback is taken to be
+// broken.
+static constexpr uint64_t TimeoutCycles = CPU_TIMER_HZ;
+
+static constexpr std::pair<OpenTitanUart::TransmitWatermark, uint32_t>
+  TransmitLevels[] = {
+    {OpenTitanUart::TransmitWatermark::Level1, 1},
+    {OpenTitanUart::TransmitWatermark::Level2, 2},
+    {OpenTitanUart::TransmitWatermark::Level4, 4},
+    {OpenTitanUart::TransmitWatermark::Level8, 8},
+    {OpenTitanUart::TransmitWatermark::Level16, 16},
+};
+
+static constexpr std::pair<OpenTitanUart::ReceiveWatermark, uint32_t>
+  ReceiveLevels[] = {
+    {OpenTitanUart::ReceiveWatermark::Level1, 1},
+    {OpenTitanUart::ReceiveWatermark::Level2, 2},
+    {OpenTitanUart::ReceiveWatermark::Level4, 4},
+    {OpenTitanUart::ReceiveWatermark::Level8, 8},
+    {OpenTitanUart::ReceiveWatermark::Level16, 16},
+    {OpenTitanUart::ReceiveWatermark::Level32, 32},
+};
+
+/// Helper.  Puts `uart` into loopback at `baudRate` with empty FIFOs.
+static void setup(UartPtr uart, unsigned baudRate)
+{
+	uart->init(baudRate);
+	uart->fifos_clear();
+	uart->parity();
+	uart->loopback();
+}
+
+/// Helper.  Returns `bytes` transferred in `cycles` as bytes per second.
+static uint32_t bytes_per_second(size_t bytes, uint64_t cycles)
+{
+	if (cycles == 0)
+	{
+		return 0;
+	}
+	return static_cast<uint32_t>(static_cast<uint64_t>(bytes) * CPU_TIMER_HZ /
+	                             cycles);
+}
+
+/**
+ * Streams `StreamBytes` through the loopback as fast as the transmit FIFO
+ * takes them, reading them back as they arrive.  Transmit throughput is
+ * measured until the transmit FIFO has emptied, and receive throughput
+ * between the first and last bytes arriving.
+ */
+static bool throughput(UartPtr uart, unsigned baudRate)
+{
+	setup(uart, baudRate);
+	const uint64_t Start         = rdcycle64();
+	uint64_t       transmitted   = 0;
+	uint64_t       firstReceived = 0;
+	uint64_t       lastReceived  = 0;
+	size_t         sent          = 0;
+	size_t         received      = 0;
+	while (received < StreamBytes || transmitted == 0)
+	{
+		if (sent < StreamBytes && uart->can_write())
+		{
+			uart->blocking_write(static_cast<uint8_t>(sent++));
+		}
+		if (uart->can_read())
+		{
+			if (uart->blocking_read() != static_cast<uint8_t>(received))
+			{
+				Debug::log("Byte {} came back wrong at {} baud",
+				           static_cast<int>(received),
+				           static_cast<int>(baudRate));
+				return false;
+			}
+			lastReceived = rdcycle64();
+			if (received++ == 0)
+			{
+				firstReceived = lastReceived;
+			}
+		}
+		if (sent == StreamBytes && transmitted == 0 &&
+		    uart->transmit_fifo_level() == 0)
+		{
+			transmitted = rdcycle64();
+		}
+		if (rdcycle64() - Start > TimeoutCycles)
+		{
+			Debug::log("Loopback timed out at {} baud",
+			           static_cast<int>(baudRate));
+			return false;
+		}
+	}
+	const uint32_t LineRate = baudRate / BitsPerByte;
+	const uint32_t Transmit =
+	  bytes_per_second(StreamBytes, transmitted - Start);
+	const uint32_t Receive =
+	  bytes_per_second(StreamBytes - 1, lastReceived - firstReceived);
+	Debug::log("result=uart_throughput baud={} line_bytes_per_second={} "
+	           "tx_bytes_per_second={} rx_bytes_per_second={} "
+	           "rx_percent_of_line={}",
+	           static_cast<int>(baudRate),
+	           static_cast<int>(LineRate),
+	           static_cast<int>(Transmit),
+	           static_cast<int>(Receive),
+	           static_cast<int>(Receive * 100 / LineRate));
+	return true;
+}
+
+/**
+ * Sends single bytes through an idle loopback and times each from being
+ * written to the receive watermark interrupt, at level one, being raised.
+ * This is how soon a thread woken by that interrupt could run, less the
+ * scheduler's part.
+ */
+static bool latency(UartPtr uart, unsigned baudRate)
+{
+	setup(uart, baudRate);
+	uart->receive_watermark(OpenTitanUart::ReceiveWatermark::Level1);
+	uint64_t minimum = UINT64_MAX;
+	uint64_t maximum = 0;
+	uint64_t total   = 0;
+	for (uint32_t i = 0; i < LatencySamples; i++)
+	{
+		// Clear the interrupt, which is only raised again by a new byte.
+		uart->interruptState = OpenTitanUart::InterruptReceiveWatermark;
+		const uint64_t Start = rdcycle64();
+		uart->blocking_write(static_cast<uint8_t>(i));
+		uint64_t elapsed;
+		while (((elapsed = rdcycle64() - Start) < TimeoutCycles) &&
+		       (uart->interruptState &
+		        OpenTitanUart::InterruptReceiveWatermark) == 0)
+		{
+		}
+		if (elapsed >= TimeoutCycles ||
+		    uart->blocking_read() != static_cast<uint8_t>(i))
+		{
+			Debug::log("No latency sample {} at {} baud",
+			           static_cast<int>(i),
+			           static_cast<int>(baudRate));
+			return false;
+		}
+		minimum = std::min(minimum, elapsed);
+		maximum = std::max(maximum, elapsed);
+		total += elapsed;
+	}
+	Debug::log("result=uart_latency baud={} line_cycles={} min_cycles={} "
+	           "mean_cycles={} max_cycles={}",
+	           static_cast<int>(baudRate),
+	           static_cast<int>(static_cast<uint64_t>(CPU_TIMER_HZ) *
+	                            BitsPerByte / baudRate),
+	           static_cast<int>(minimum),
+	           static_cast<int>(total / LatencySamples),
+	           static_cast<int>(maximum));
+	return true;
+}
+
+/**
+ * For each transmit watermark level, counts the bytes written to an empty
+ * FIFO while the transmit watermark interrupt stays raised, as
+ * `interrupt_state_test` does for level four.
+ */
+static void transmit_watermarks(UartPtr uart)
+{
+	for (auto [watermark, level] : TransmitLevels)
+	{
+		setup(uart, WatermarkBaudRate);
+		uart->transmit_watermark(watermark);
+		uint32_t writes = 0;
+		while ((uart->interruptState &
+		        OpenTitanUart::InterruptTransmitWatermark) &&
+		       writes < StreamBytes)
+		{
+			uart->blocking_write('x');
+			writes++;
+		}
+		Debug::log(
+		  "result=uart_tx_watermark level={} writes_while_raised={}",
+		  static_cast<int>(level),
+		  static_cast<int>(writes));
+	}
+}
+
+/**
+ * For each receive watermark level, sends bytes one at a time, letting each
+ * arrive, and records how full the receive FIFO was when the receive
+ * watermark interrupt was first seen.
+ */
+static bool receive_watermarks(UartPtr uart)
+{
+	for (auto [watermark, level] : ReceiveLevels)
+	{
+		setup(uart, WatermarkBaudRate);
+		uart->receive_watermark(watermark);
+		uart->interruptState = OpenTitanUart::InterruptReceiveWatermark;
+		const uint64_t Start = rdcycle64();
+		uint32_t       sent  = 0;
+		while ((uart->interruptState &
+		        OpenTitanUart::InterruptReceiveWatermark) == 0)
+		{
+			if (uart->receive_fifo_level() == sent && sent < 2 * level)
+			{
+				uart->blocking_write('x');
+				sent++;
+			}
+			if (rdcycle64() - Start > TimeoutCycles)
+			{
+				Debug::log("Receive watermark {} was never raised",
+				           static_cast<int>(level));
+				return false;
+			}
+		}
+		Debug::log(
+		  "result=uart_rx_watermark level={} fifo_level_when_raised={}",
+		  static_cast<int>(level),
+		  static_cast<int>(uart->receive_fifo_level()));
+	}
+	return true;
+}
+
+bool __cheri_libcall uart_benchmark()
+{
+	UartPtr uart1 = MMIO_CAPABILITY(OpenTitanUart, uart1);
+
+	for (unsigned baudRate : BaudRates)
+	{
+		if (!throughput(uart1, baudRate) || !latency(uart1, baudRate))
+		{
+			return false;
+		}
+	}
+	transmit_watermarks(uart1);
+	if (!receive_watermarks(uart1))
+	{
+		return false;
+	}
+	Debug::log("All benchmarks finished");
+	return true;
+}
@@ -0,0 +1,6 @@
+// Copyright lowRISC Contributors.
+// SPDX-License-Identifier: Apache-2.0
+
+#include <cdefs.h>
+
+bool __cheri_libcall uart_benchmark();
@@ -8,8 +8,12 @@
 #include <futex.h>
 #include <interrupt.h>
 #include <platform-uart.hh>
+#include <riscvreg.h>
+#include <string.h>
 #include <thread.h>
 
+#include "../libraries/uart_lines.hh"
+
 using Debug   = ConditionalDebug<true, "Uart Test">;
 using UartPtr = volatile OpenTitanUart *;
 
@@ -52,6 +56,142 @@ bool interrupt_state_test(UartPtr uart)
 	return count == 5;
 }
 
+/// The baud rate of the burst tests.
+static constexpr unsigned BurstBaudRate = 921'600;
+/**
+ * Cycles between the burst tests' polls.  Bytes arrive at about a tenth of
+ * the baud rate; this lets a quarter of a receive FIFO's worth arrive.
+ */
+static constexpr uint64_t PollGapCycles =
+  static_cast<uint64_t>(CPU_TIMER_HZ) * 16 * 10 / BurstBaudRate;
+
+/**
+ * Sends lines through the UART in loopback at full speed, polling a
+ * `sonata::UartLines` only every few bytes' time, as a busy thread would,
+ * and checks that every line arrives intact with nothing dropped.
+ */
+bool burst_line_test(UartPtr uart)
+{
+	static constexpr size_t BurstLines  = 64;
+	static constexpr size_t LineBytes   = 40;
+	static constexpr size_t StreamBytes = BurstLines * (LineBytes + 1);
+	// On the stack, as a library has no globals of its own.
+	sonata::UartLines<8, LineBytes> lines;
+
+	// Each line is `LineBytes` letters, followed by a newline.
+	auto streamByte = [](size_t index) -> char {
+		const size_t Line     = index / (LineBytes + 1);
+		const size_t Position = index % (LineBytes + 1);
+		return Position == LineBytes ? '\n' : 'A' + (Line + Position) % 26;
+	};
+
+	uart->init(BurstBaudRate);
+	uart->fifos_clear();
+	uart->parity();
+	uart->loopback();
+
+	// The burst takes a few tens of milliseconds; allow a second.
+	const uint64_t Deadline = rdcycle64() + CPU_TIMER_HZ;
+	uint64_t       lastPoll = 0;
+	size_t         sent     = 0;
+	size_t         received = 0;
+	while (received < BurstLines)
+	{
+		while (sent < StreamBytes && uart->can_write())
+		{
+			uart->blocking_write(streamByte(sent++));
+		}
+		if (rdcycle64() - lastPoll >= PollGapCycles)
+		{
+			lines.poll(uart, false);
+			lastPoll = rdcycle64();
+		}
+		size_t length;
+		while (const char *line = lines.next(length))
+		{
+			if (length != LineBytes)
+			{
+				return false;
+			}
+			for (size_t i = 0; i < length; i++)
+			{
+				if (line[i] != streamByte(received * (LineBytes + 1) + i))
+				{
+					return false;
+				}
+			}
+			lines.release(line);
+			received++;
+		}
+		if (rdcycle64() > Deadline)
+		{
+			Debug::log("Received {} of {} lines", received, BurstLines);
+			return false;
+		}
+	}
+	return lines.dropped_lines() == 0 && lines.overflow_count() == 0;
+}
+
+/**
+ * Sends two lines through the UART in loopback to a `sonata::UartLines`
+ * that echoes what it receives, polled as in `burst_line_test`.  Each line
+ * echoed loops back to be received and echoed again, so the lines then
+ * circulate through the echo path with the transmitter kept busy.  Checks
+ * that they keep arriving intact with no echo or line dropped.
+ */
+bool burst_echo_test(UartPtr uart)
+{
+	// Ended as the echo ends lines, so that every pass is the same.
+	static constexpr char   Stream[]   = "ABCDEFGHIJ\r\nKLMNOPQRST\r\n";
+	static constexpr size_t LineBytes  = 10;
+	static constexpr size_t BurstLines = 256;
+	sonata::UartLines<4, 16> lines;
+
+	uart->init(BurstBaudRate);
+	uart->fifos_clear();
+	uart->parity();
+	uart->loopback();
+	// Nothing is echoed until the first poll, so this can't be interleaved
+	// with echoes.
+	for (size_t i = 0; i < sizeof(Stream) - 1; i++)
+	{
+		uart->blocking_write(Stream[i]);
+	}
+
+	// Each pass takes about a third of a millisecond; allow a second.
+	const uint64_t Deadline = rdcycle64() + CPU_TIMER_HZ;
+	uint64_t       lastPoll = 0;
+	size_t         received = 0;
+	while (received < BurstLines)
+	{
+		if (rdcycle64() - lastPoll >= PollGapCycles)
+		{
+			lines.poll(uart, true);
+			lastPoll = rdcycle64();
+		}
+		size_t length;
+		while (const char *line = lines.next(length))
+		{
+			const char *expected = Stream + (received % 2) * (LineBytes + 2);
+			if (length != LineBytes || memcmp(line, expected, length) != 0)
+			{
+				return false;
+			}
+			lines.release(line);
+			received++;
+		}
+		if (rdcycle64() > Deadline)
+		{
+			Debug::log("Received {} of {} echoed lines",
+			           static_cast<int>(received),
+			           static_cast<int>(BurstLines));
+			return false;
+		}
+	}
+	return lines.dropped_lines() == 0 && lines.overflow_count() == 0 &&
+	       lines.dropped_echoes() == 0;
+}
+
 bool __cheri_libcall uart_tests()
 {
 	UartPtr uart1 = MMIO_CAPABILITY(OpenTitanUart, uart1);
@@ -59,6 +199,8 @@ bool __cheri_libcall uart_tests()
 	std::pair<const char *, std::function<bool(UartPtr)>> testFunctions[] = {
 	  {"loopback test", loopback_test},
 	  {"interrupt state test", interrupt_state_test},
+	  {"burst line test", burst_line_test},
+	  {"burst echo test", burst_echo_test},
 	};
 	for (auto [name, function] : testFunctions)
 	{
@@ -17,8 +17,13 @@ library("uart_tests")
     add_deps("debug")
     add_files("uart_tests.cc")
 
+library("uart_benchmark")
+    set_default(false)
+    add_deps("debug")
+    add_files("uart_benchmark.cc")
+
 compartment("test_runner")
-    add_deps("debug", "uart_tests")
+    add_deps("debug", "uart_tests", "uart_benchmark")
     add_files("test_runner.cc")
 
 firmware("sonata_test_suite")
@@ -30,7 +35,8 @@ firmware("sonata_test_suite")
                 compartment = "test_runner",
                 priority = 20,
                 entry_point = "run_tests",
-                stack_size = 0x400,
+                -- The UART burst tests keep their line buffers on the stack.
+                stack_size = 0x800,
                 trusted_stack_frames = 3
             },
         }, {expand = false})